@@ -5,13 +5,25 @@
 
 #include "arith_cod.h"
 
+// The adaptive model halves its counts once their sum passes this
+#define ADAPTIVE_MAX_TOTAL (1 << 16)
+// Same for the Fenwick model, keeps length / total >= 2^7 at AC_MODEL_MIN_PRECISION
+#define MODEL_MAX_TOTAL (1 << 16)
+// Context model counts are 16-bit, a context is halved before its total would overflow
+#define CONTEXT_MAX_TOTAL 0xFFFF
 
-void init_state(ac_state_t* state, int precision) 
+
+void init_state(ac_state_t* state, int precision, int alphabet_size) 
 {
-    state->prob_table = calloc(sizeof(int) * 128,1);
-    state->cumul_table = calloc(sizeof(int) * 128,1);
+    assert(precision >= AC_TABLE_BITS && precision <= AC_MAX_PRECISION && "unsupported precision");
+    assert(alphabet_size > 0 && alphabet_size <= AC_MAX_SYMBOLS && "unsupported alphabet");
+
+    state->prob_table = calloc(sizeof(int) * alphabet_size,1);
+    // one entry per symbol plus the upper bound of the last one
+    state->cumul_table = calloc(sizeof(int) * (alphabet_size + 1),1);
 
     state->frac_size = precision;
+    state->alphabet_size = alphabet_size;
 
     state->one_counter = 0;
     state->last_symbol = -1;
@@ -21,62 +33,86 @@ void init_state(ac_state_t* state, int precision)
 
     state->out_index = 0;
 
+    state->bit_buffer   = 0;
+    state->bit_count    = 0;
+    state->byte_index   = 0;
+    state->held_bit     = -1;
+    state->pending_ones = 0;
+
     state->base = 0;
-    state->length = (1 << precision) - 1;
+    state->length = (uint32_t) (((uint64_t) 1 << precision) - 1);
+    state->in_bits = 0;
 
     assert(state->prob_table && state->cumul_table && "memory allocation failed");
 }
 
+// Scale the counts in prob_table (summing to total) onto the 2^AC_TABLE_BITS range.
+// One reciprocal per table, every symbol keeps at least 2 so its interval never
+// rounds to zero, 2 spare values per symbol (plus the top one) absorb that floor.
+static void normalize_counts(ac_state_t* state, int total)
+{
+    int i;
+    int n = state->alphabet_size;
+    uint64_t scale = ((uint64_t) ((1 << AC_TABLE_BITS) - 2 * n - 2) << 32) / total;
+
+    state->cumul_table[0] = 0;
+    for (i = 0; i < n; ++i) {
+        int local_prob = (int) ((state->prob_table[i] * scale) >> 32);
+        if (local_prob < 2) local_prob = 2;
+        state->cumul_table[i+1] = state->cumul_table[i] + local_prob;
+    }
+    state->cumul_table[n] = (1 << AC_TABLE_BITS) - 1;
+}
+
 //做出cumul_table
 void transform_count_to_cumul(ac_state_t* state, int _)  
 {
     (void)_; // unused
     int i;
     int size = 0;
-    int alphabet_size = 128;
+    int alphabet_size = state->alphabet_size;
     for (i = 0; i < alphabet_size; ++i) size += state->prob_table[i];
 
     // state format & count cumul
-    for (i = 0; i < alphabet_size; ++i) {
-        int count = state->prob_table[i];
-        int local_prob = ((long long) count * ((1 << state->frac_size)-258)) / (size);
-        //if (i == 0) state->cumul_table[0] = state->prob_table[0];
-        //else state->cumul_table[i] = state->cumul_table[i-1] + state->prob_table[i];
-        if (i == 0) {
-            state->cumul_table[0] = 0;
-        }
-            state->cumul_table[i+1] = state->cumul_table[i] + local_prob;
-    }
-    state->cumul_table[128] = ((long long) 1 << state->frac_size) - 1;
+    normalize_counts(state, size);
 }
 
-void build_probability_table(ac_state_t* state, const unsigned char* in, int size) 
+void build_probability_table(ac_state_t* state, const unsigned char* in, size_t size) 
 {
-    int alphabet_size = 128;
-    int count_weight = 1;
+    int alphabet_size = state->alphabet_size;
+    uint64_t counts[AC_MAX_SYMBOLS];
     int i;
     // reset 預設值set1
-    for (i = 0; i < alphabet_size; ++i) state->prob_table[i] = 1;
+    for (i = 0; i < alphabet_size; ++i) counts[i] = 1;
 
     // counting  probability
-    for (i = 0; i < size; ++i) state->prob_table[in[i]] += count_weight;
+    for (size_t j = 0; j < size; ++j) counts[in[j]]++;
+
+    // prob_table holds ints, past 2^30 the counts are scaled down, only their ratios matter
+    uint64_t total = (uint64_t) size + alphabet_size;
+    int shift = 0;
+    while ((total >> shift) > (1u << 30)) shift++;
+    for (i = 0; i < alphabet_size; ++i) {
+        uint64_t count = counts[i] >> shift;
+        state->prob_table[i] = count > 0 ? (int) count : 1;
+    }
 
     // normalization according to state format
-    transform_count_to_cumul(state, count_weight * size);
+    transform_count_to_cumul(state, 0);
 
 }
 
 void reset_uniform_probability(ac_state_t* state)
 {
-    int alphabet_size = 128;
+    int alphabet_size = state->alphabet_size;
     int size = 0;
     int i;
 
-    for (i = 0; i < 128; ++i) state->prob_table[i] = 1;
+    for (i = 0; i < alphabet_size; ++i) state->prob_table[i] = 1;
 
-    for (i = 0; i < 128; ++i) {
+    for (i = 0; i < alphabet_size; ++i) {
         int count = state->prob_table[i];
-        state->prob_table[i] = ((long long) count * (1 << state->frac_size)) / (size + alphabet_size);
+        state->prob_table[i] = ((long long) count * (1 << AC_TABLE_BITS)) / (size + alphabet_size);
         if (i == 0) {
             state->cumul_table[0] = 0;
             state->cumul_table[1] = state->prob_table[0];
@@ -88,71 +124,110 @@ void reset_uniform_probability(ac_state_t* state)
 void reset_prob_table(ac_state_t* state)
 {
     int i;
-    for (i = 0; i < 128; ++i) state->prob_table[i] = 1;
+    for (i = 0; i < state->alphabet_size; ++i) state->prob_table[i] = 1;
 }
 
 void display_prob_table(ac_state_t* state) 
 {
     int i;
-    double norm = (double) ((1 << state->frac_size));
-    for (i = 0; i < 128; i++) {
+    double norm = (double) ((1 << AC_TABLE_BITS));
+    for (i = 0; i < state->alphabet_size; i++) {
         printf("P[%i]=%.6f, C[%i/%x]=%.6f / %x\n", i, state->prob_table[i] / norm, i, i, state->cumul_table[i] / norm, state->cumul_table[i]); 
     }
-    i = 128;
+    i = state->alphabet_size;
     printf("P[%i]=%.6f, C[%i/%02x]=%.6f / %x\n", i, 0.0, i, i, state->cumul_table[i] / norm, state->cumul_table[i]); 
 }
 
-void set_bit_value(unsigned char* out, int index, int bit_value) 
+int get_bit_value(unsigned char* out, size_t index) 
 {
-    if (bit_value) {
-        out[index / 8] |= (1 << (7 - (index % 8)));
-    } else {
-        out[index / 8] &= ~(1 << ((7 - index % 8)));
-    }
+    return (out[index / 8] >> (7 - (index % 8))) & 0x1;
 }
 
 
-int get_bit_value(unsigned char* out, int index) 
+// Append count (<= 32) bits to the sink, a full 64-bit register is stored at once
+static void put_bits(unsigned char* out, ac_state_t* state, uint32_t value, int count)
 {
-    return (out[index / 8] >> (7 - (index % 8))) & 0x1;
+    int room = 64 - state->bit_count;
+    if (count < room) {
+        state->bit_buffer = (state->bit_buffer << count) | value;
+        state->bit_count += count;
+        return;
+    }
+    int rest = count - room;
+    uint64_t word = room == 64 ? value : (state->bit_buffer << room) | ((uint64_t) value >> rest);
+    for (int i = 0; i < 8; ++i) out[state->byte_index++] = (unsigned char) (word >> (56 - 8 * i));
+    state->bit_buffer = rest > 0 ? value & ((1u << rest) - 1) : 0;
+    state->bit_count = rest;
 }
 
 
-unsigned char* output_zero(unsigned char* out, ac_state_t* state) 
+// Append a run of identical bits
+static void put_run(unsigned char* out, ac_state_t* state, int bit, int count)
 {
-    assert(state->out_index >= 0 && "out_index must be positive");
+    while (count > 0) {
+        int n = count < 32 ? count : 32;
+        put_bits(out, state, bit ? (uint32_t) (((uint64_t) 1 << n) - 1) : 0, n);
+        count -= n;
+    }
+}
 
-    set_bit_value(out, state->out_index, 0);
-    state->out_index++;
 
-    return NULL;
+// Write out the held 0 and the 1 bits that follow it, they can no longer change
+static void release_pending(unsigned char* out, ac_state_t* state)
+{
+    if (state->held_bit >= 0) put_bits(out, state, 0, 1);
+    put_run(out, state, 1, state->pending_ones);
+    state->held_bit = -1;
+    state->pending_ones = 0;
 }
 
 
-unsigned char* output_one(unsigned char* out, ac_state_t* state) 
+/* Emit the count (< 32) renormalization digits in value, MSB first.
+ * A carry can only reach back to the last 0 digit, so that 0 and the 1 digits
+ * after it are held back and everything before them is final. */
+static void output_digits(unsigned char* out, ac_state_t* state, uint32_t value, int count)
 {
-    assert(state->out_index >= 0 && "out_index must be positive");
+    int ones = 0;
+    while (ones < count && ((value >> ones) & 1)) ones++;
+
+    state->out_index += count;
+    if (ones == count) {
+        // no 0 digit: extend the pending run, or emit directly if no carry can reach it
+        if (state->held_bit >= 0) state->pending_ones += count;
+        else put_run(out, state, 1, count);
+        return;
+    }
+
+    release_pending(out, state);
+    int final_count = count - ones - 1;
+    if (final_count > 0) put_bits(out, state, value >> (ones + 1), final_count);
+    state->held_bit = 0;
+    state->pending_ones = ones;
+}
 
-    set_bit_value(out, state->out_index, 1);
-    state->out_index++;
 
-    return NULL;
+// Add one to the code at the last emitted digit: 0111..1 becomes 1000..0
+void propagate_carry(unsigned char* out, ac_state_t* state)
+{
+    assert(state->held_bit == 0 && "carry without a 0 digit to absorb it");
+    put_bits(out, state, 1, 1);
+    put_run(out, state, 0, state->pending_ones);
+    state->held_bit = -1;
+    state->pending_ones = 0;
 }
 
 
-void output_digit(unsigned char* out, ac_state_t* state, int digit)
+// Store every outstanding bit, the last byte is padded with zeros
+static void flush_output(unsigned char* out, ac_state_t* state)
 {
-    switch (digit) {
-    case 0:
-        output_zero(out, state);
-        break;
-    case 1:
-        output_one(out, state);
-        break;
-    default:
-        assert(0 && "unexpected digit value in output_digit\n");
-        break;
+    release_pending(out, state);
+    while (state->bit_count > 0) {
+        int shift = state->bit_count - 8;
+        out[state->byte_index++] = (unsigned char) (shift >= 0 ? state->bit_buffer >> shift : state->bit_buffer << -shift);
+        state->bit_count -= 8;
     }
+    state->bit_count = 0;
+    state->bit_buffer = 0;
 }
 
 
@@ -169,41 +244,23 @@ void display_bin(unsigned char* out, int bit_size)
 }
 
 
-void propagate_carry(unsigned char* out, ac_state_t* state) 
-{
-    int index = state->out_index - 1;
-    while (get_bit_value(out, index) == 1) {
-        set_bit_value(out, index, 0);
-        index--;
-    }
-    set_bit_value(out, index, 1);
-}
-
-
-int state_half_length(ac_state_t* state)
+uint32_t state_half_length(ac_state_t* state)
 {
-    return 1 << (state->frac_size - 1);
+    return (uint32_t) 1 << (state->frac_size - 1);
 }
 
 
-int modulo_precision(ac_state_t* state, int value) 
+uint32_t modulo_precision(ac_state_t* state, uint64_t value) 
 {   //value%2 的 state->frac_size 次方
-    return value % (1 << state->frac_size);
+    return (uint32_t) (value & (((uint64_t) 1 << state->frac_size) - 1));
 }
 
-void encode_character(unsigned char* out, unsigned char in, ac_state_t* state) 
+// Narrow the interval to [base + base_increment, + new_length) and renormalize
+static void encode_interval(unsigned char* out, ac_state_t* state, uint32_t base_increment, uint32_t new_length)
 {
-    int in_cumul   = state->cumul_table[in];
-
-    // interval update
-    //Y is new upper bound
-    int Y = ((long long) state->length * state->cumul_table[in + 1]) >> state->frac_size;
-    int base_increment = ((long long) state->length * in_cumul) >> state->frac_size;
-
-    int new_base   = modulo_precision(state, state->base + base_increment);
-    int new_length = Y - base_increment;
+    uint32_t new_base = modulo_precision(state, (uint64_t) state->base + base_increment);
 
-    assert(new_base >= 0 && new_length > 0 && "intermediary values must be positive");
+    assert(new_length > 0 && "intermediary values must be positive");
 
     if (new_base < state->base) {
         // propagate carry
@@ -211,229 +268,486 @@ void encode_character(unsigned char* out, unsigned char in, ac_state_t* state)
     }
 
     //確保範圍足夠大
-    while (new_length < state_half_length(state)) {
-        // renormalization
-        int digit = (new_base * 2) >> state->frac_size;
-        output_digit(out, state, digit);
-        new_length = modulo_precision(state, 2 * new_length);
-        new_base   = modulo_precision(state, 2 * new_base);
+    // renormalization: shift until length reaches half, the shifted-out base bits are the digits
+    int shift = 0;
+    while ((new_length << shift) < state_half_length(state)) shift++;
+    if (shift > 0) {
+        output_digits(out, state, new_base >> (state->frac_size - shift), shift);
+        new_length = new_length << shift;
+        new_base   = modulo_precision(state, (uint64_t) new_base << shift);
     }
 
     state->base   = new_base;
     state->length = new_length;
-
 }
 
-unsigned char decode_character( unsigned char* in, ac_state_t* state) 
+void encode_character(unsigned char* out, unsigned char in, ac_state_t* state) 
 {
-    // input value
-    int length = state->length;
-    int V      = state->base;
-    int t      = state->out_index;
-
-    //printf(state->cumul_table[256]);
+    uint32_t in_cumul = state->cumul_table[in];
 
-    // interval selection
-    //printf("test1");
-    int s = 0, n = 128, X = 0;
-    long long Y= ((long long) length * state->cumul_table[128]) >> state->frac_size;
-    // 使用 Y 進行後續操作
-    //printf("cumul %d",state->cumul_table[256]);
-    //printf("Y: %lld\n", Y);
-    //printf("test2");
+    // interval update
+    //Y is new upper bound
+    uint32_t Y = ((uint64_t) state->length * (uint32_t) state->cumul_table[in + 1]) >> AC_TABLE_BITS;
+    uint32_t base_increment = ((uint64_t) state->length * in_cumul) >> AC_TABLE_BITS;
 
-        
-        while (n - s > 1) {
-        int m = (s + n) / 2;
-        int Z = ((long long) length * state->cumul_table[m]) >> state->frac_size;
+    encode_interval(out, state, base_increment, Y - base_increment);
+}
 
-        if (Z > V) { n = m; Y = Z;}
-        else { s = m; X = Z;};
-        }
-        
-    //printf("test3");
+// Bit index of the input, the bits past its end are 0
+static int input_bit(unsigned char* in, const ac_state_t* state, size_t index)
+{
+    return index < state->in_bits ? get_bit_value(in, index) : 0;
+}
 
+/* A decoder whose window reaches more than frac_size bits past the input was
+ * given fewer bits than the encoder wrote: the last digit it needs is within
+ * frac_size bits of the end. */
+static int input_overrun(const ac_state_t* state)
+{
+    return state->out_index + 1 > state->in_bits + state->frac_size;
+}
 
-    V = V - X;
-    length = Y - X;
+/* Keep the decoder on the sub-interval starting at X with length new_length and
+ * renormalize. Only damaged tables give an empty interval, doubling never grows
+ * it: the decoder is then marked past its input so input_overrun stops it. */
+static int decode_interval(unsigned char* in, ac_state_t* state, uint32_t X, uint32_t new_length)
+{
+    uint32_t V      = state->base - X;
+    uint32_t length = new_length;
+    size_t   t      = state->out_index;
 
-    
+    if (length == 0) {
+        state->out_index = state->in_bits + state->frac_size;
+        return -1;
+    }
     while (length < state_half_length(state)) {
         // renormalization
         t++;
-        V = modulo_precision(state, 2 * V) + get_bit_value(in, t);
-        length = modulo_precision(state, 2 * length);
+        V = modulo_precision(state, 2 * (uint64_t) V) + input_bit(in, state, t);
+        length = modulo_precision(state, 2 * (uint64_t) length);
     }
-    
 
     //output
     state->length    = length;
     state->base      = V;
     state->out_index = t;
-    
-    
+    return 0;
+}
+
+void build_lookup_table(ac_state_t* state)
+{
+    int n = state->alphabet_size;
+    int shift = AC_TABLE_BITS - AC_LOOKUP_BITS;
+    int s = 0;
+    // s only moves forward, so a damaged (non monotonic) table still ends in bounds
+    for (int slot = 0; slot < (1 << AC_LOOKUP_BITS); ++slot) {
+        while (s < n - 1 && state->cumul_table[s + 1] <= (slot << shift)) s++;
+        state->lookup_table[slot] = (unsigned char) s;
+    }
+}
+
+/* The symbol is the last one with length * cumul_table[s] >> AC_TABLE_BITS <= V,
+ * that is cumul_table[s] <= target below: one division instead of a binary
+ * search, the slot table gives the symbol and the rare symbols sharing its slot
+ * are skipped with plain compares. */
+unsigned char decode_character( unsigned char* in, ac_state_t* state) 
+{
+    // input value
+    uint32_t length = state->length;
+    uint32_t V      = state->base;
+
+    // interval selection
+    int n = state->alphabet_size;
+    uint32_t target = ((((uint64_t) V + 1) << AC_TABLE_BITS) - 1) / length;
+    uint32_t slot = target >> (AC_TABLE_BITS - AC_LOOKUP_BITS);
+    if (slot >= (1u << AC_LOOKUP_BITS)) slot = (1u << AC_LOOKUP_BITS) - 1;
+
+    int s = state->lookup_table[slot];
+    while (s < n - 1 && (uint32_t) state->cumul_table[s + 1] <= target) s++;
 
+    uint32_t X = ((uint64_t) length * (uint32_t) state->cumul_table[s]) >> AC_TABLE_BITS;
+    uint32_t Y = ((uint64_t) length * (uint32_t) state->cumul_table[s + 1]) >> AC_TABLE_BITS;
+
+    decode_interval(in, state, X, Y - X);
     return s;
 }
 
 void select_value(unsigned char* out, ac_state_t* state) 
 {
     // code value selection (flushing buffer)
-    int base = state->base;
-    int new_base = modulo_precision(state, state->base + state_half_length(state) / 2);
-    int new_length = (1 << (state->frac_size - 2)) - 1;
+    uint32_t base = state->base;
+    uint32_t new_base = modulo_precision(state, (uint64_t) state->base + state_half_length(state) / 2);
     if (base > new_base) propagate_carry(out, state);
 
-    // renormalization (output two symbols)
-    while (new_length < state_half_length(state)) {
-        int digit = (new_base * 2) >> state->frac_size;
-        output_digit(out, state, digit);
-        new_length = modulo_precision(state, 2 * new_length);
-        new_base   = modulo_precision(state, 2 * new_base);
-    }
+    // renormalization (output two symbols), length is a quarter so exactly two digits
+    output_digits(out, state, new_base >> (state->frac_size - 2), 2);
+    flush_output(out, state);
 }
 
 void encode_value(unsigned char* out, const unsigned char* in, size_t size, ac_state_t* state) 
 {
-    int i=0;
-    size_t j;
-    
     // encoding each character
-    for (j = 0; j < size; ++j){
+    for (size_t i = 0; i < size; ++i) {
         encode_character(out, in[i], state);
-        i++;
     }
 
     select_value(out, state);
 }
 
-void init_decoding(unsigned char* in, ac_state_t* state)
+void init_decoding(unsigned char* in, size_t in_bits, ac_state_t* state)
 {
-    int length = (1 << state->frac_size) - 1;
-    int V = 0;
+    uint32_t length = modulo_precision(state, (uint64_t) -1);
+    uint32_t V = 0;
     int k;
+    state->in_bits = in_bits;
     for (k = 0; k < state->frac_size; k++) {
-        V |= get_bit_value(in, k) << (state->frac_size - 1 - k);
+        V |= (uint32_t) input_bit(in, state, k) << (state->frac_size - 1 - k);
     }
 
-    int t = state->frac_size - 1;
+    size_t t = state->frac_size - 1;
 
     state->out_index = t;
     state->base      = V;
     state->length    = length;
 }
 
-void decode_value(unsigned char* out, unsigned char* in, ac_state_t* state, size_t expected_size) 
+int decode_value(unsigned char* out, unsigned char* in, size_t in_bits, ac_state_t* state, size_t expected_size) 
 {
+    build_lookup_table(state);
 
-    init_decoding(in, state);
+    init_decoding(in, in_bits, state);
     size_t i;
     
     for (i = 0; i < expected_size; ++i) {
         
         *(out++) = decode_character(in, state);
+        if (input_overrun(state)) return -1;
 
     }
-    
+    return 0;
+}
 
+// Start the adaptive model from a count of 1 per symbol, returns the count total
+static int reset_adaptive_model(ac_state_t* state)
+{
+    reset_prob_table(state);
+    normalize_counts(state, state->alphabet_size);
+    return state->alphabet_size;
 }
 
-void encode_value_with_update(unsigned char* out, unsigned char* in, size_t size, ac_state_t* state, int update_range, int range_clear) 
+/* Count one coded symbol. The sum of counts is carried along instead of being
+ * recomputed, and the cumulative table is rebuilt only every update_range
+ * symbols, so encoder and decoder see the same table at the same position. */
+static int update_adaptive_model(ac_state_t* state, unsigned char symbol, int total,
+                    int* update_count, int update_range, int range_clear)
 {
+    state->prob_table[symbol]++;
+    total++;
+    if (++*update_count < update_range) return total;
+
+    *update_count = 0;
+    if (total > ADAPTIVE_MAX_TOTAL) {
+        // halve the counts so recent input keeps its weight
+        int i;
+        total = 0;
+        for (i = 0; i < state->alphabet_size; ++i) {
+            state->prob_table[i] = (state->prob_table[i] + 1) / 2;
+            total += state->prob_table[i];
+        }
+    }
+    normalize_counts(state, total);
 
-    int update_count = 0;
-    int k;
-    // reseting count
-    for (size_t i = 0; i < 128; i++){
-        state->prob_table[k] = 1;
-        k++;
+    // reseting count, the table just built stays in use until the next update
+    if (range_clear) {
+        reset_prob_table(state);
+        total = state->alphabet_size;
     }
+    return total;
+}
 
+void encode_value_with_update(unsigned char* out, const unsigned char* in, size_t size, ac_state_t* state, int update_range, int range_clear) 
+{
+    int update_count = 0;
+    int total = reset_adaptive_model(state);
 
-    k=0;
     // encoding each character
     for (size_t i = 0; i < size; ++i) {
-        unsigned char input_char = in[k];
-        k++;
-        encode_character(out, input_char, state);
-        // updating prob
-        state->prob_table[input_char]++;
-        update_count++;
-
-        // updating cumul table
-        if (update_count >= update_range) {
-            transform_count_to_cumul(state, update_count);
-            // reseting count
-            if (range_clear) {
-                update_count = 0;
-                int j;
-                for (j = 0; j < 128; j++) state->prob_table[j] = 1;
-            }
-        }
+        encode_character(out, in[i], state);
+        total = update_adaptive_model(state, in[i], total, &update_count, update_range, range_clear);
     }
 
     // code value selection (flushing buffer)
+    select_value(out, state);
+}
 
-    int base = state->base;
-    int new_base = modulo_precision(state, state->base + state_half_length(state) / 2);
-    int new_length = (1 << (state->frac_size - 2)) - 1;
-    if (base > new_base) propagate_carry(out, state);
+int decode_value_with_update(unsigned char* out, unsigned char* in, size_t in_bits, ac_state_t* state, size_t expected_size, int update_range, int range_clear) 
+{
+    int update_count = 0;
+    int total = reset_adaptive_model(state);
+    build_lookup_table(state);
 
-    // renormalization (output two symbols)
-    while (new_length < state_half_length(state)) {
-        int digit = (new_base * 2) >> state->frac_size;
-        output_digit(out, state, digit);
-        new_length = modulo_precision(state, 2 * new_length);
-        new_base   = modulo_precision(state, 2 * new_base);
+    init_decoding(in, in_bits, state);
+    for (size_t i = 0; i < expected_size; ++i) {
+        unsigned char decoded_char = decode_character(in, state);
+        if (input_overrun(state)) return -1;
+        *(out++) = decoded_char; 
+        total = update_adaptive_model(state, decoded_char, total, &update_count, update_range, range_clear);
+        // a count of 0 means the cumulative table was just rebuilt
+        if (update_count == 0) build_lookup_table(state);
     }
+    return 0;
 }
 
-void decode_value_with_update(unsigned char* out, unsigned char* in, ac_state_t* state, size_t expected_size, int update_range, int range_clear) 
+// Build the Fenwick tree over model->freq in O(n)
+static void rebuild_model_tree(ac_model_t* model)
 {
-    int update_count = 0;
-    int length = (1 << state->frac_size) - 1;
-    int V = 0;
-    int k;
-    for (k = 0; k < state->frac_size; k++) {
-        V |= get_bit_value(in, k) << (state->frac_size - 1 - k);
+    int i;
+    int n = model->symbols;
+    model->total = 0;
+    for (i = 1; i <= n; ++i) {
+        model->tree[i] = model->freq[i - 1];
+        model->total  += model->freq[i - 1];
+    }
+    for (i = 1; i <= n; ++i) {
+        int parent = i + (i & -i);
+        if (parent <= n) model->tree[parent] += model->tree[i];
     }
-    // int V = (in[0] << 8) | in[1];
+}
 
-    // reseting count
-    
-    int temp=0;
-    for (size_t i = 0; i < 128; i++){
-        state->prob_table[temp] = 1;
-        temp++;
+void init_model(ac_model_t* model, int symbols, int increment)
+{
+    int i;
+    assert((symbols == 128 || symbols == AC_MAX_SYMBOLS) && "the Fenwick model needs a power of two alphabet");
+    model->symbols = symbols;
+    for (i = 0; i < symbols; ++i) model->freq[i] = 1;
+    model->increment = increment;
+    rebuild_model_tree(model);
+}
+
+// Sum of the counts of every symbol below symbol
+static int model_cumul(const ac_model_t* model, int symbol)
+{
+    int sum = 0;
+    for (int i = symbol; i > 0; i -= i & -i) sum += model->tree[i];
+    return sum;
+}
+
+// Symbol whose range [cumul, cumul + freq) holds target, stores cumul in *low
+static int model_find(const ac_model_t* model, int target, int* low)
+{
+    int pos = 0;
+    int sum = 0;
+    for (int step = model->symbols; step > 0; step >>= 1) {
+        if (pos + step <= model->symbols && sum + model->tree[pos + step] <= target) {
+            pos += step;
+            sum += model->tree[pos];
+        }
     }
+    *low = sum;
+    return pos;
+}
 
-    int t = state->frac_size - 1;
+void update_model(ac_model_t* model, unsigned char symbol)
+{
+    model->freq[symbol] += model->increment;
+    model->total        += model->increment;
+    for (int i = symbol + 1; i <= model->symbols; i += i & -i) model->tree[i] += model->increment;
+
+    if (model->total > MODEL_MAX_TOTAL) {
+        // halve the counts so recent input keeps its weight
+        int i;
+        for (i = 0; i < model->symbols; ++i) model->freq[i] = (model->freq[i] + 1) / 2;
+        rebuild_model_tree(model);
+    }
+}
 
-    state->out_index = t;
-    state->base      = V;
-    state->length    = length;
+/* The interval is split in steps of length / total, one division per symbol.
+ * The rounding left over at the top goes to the last symbol, the decoder
+ * clamps into it the same way. */
+static void encode_counts(unsigned char* out, ac_state_t* state, uint32_t low, uint32_t freq, uint32_t total, int last)
+{
+    uint32_t step = state->length / total;
+    uint32_t base_increment = step * low;
+    uint32_t new_length = last ? state->length - base_increment : step * freq;
+
+    encode_interval(out, state, base_increment, new_length);
+}
+
+void encode_character_model(unsigned char* out, unsigned char in, ac_state_t* state, const ac_model_t* model)
+{
+    encode_counts(out, state, model_cumul(model, in), model->freq[in], model->total, in == model->symbols - 1);
+}
+
+unsigned char decode_character_model(unsigned char* in, ac_state_t* state, const ac_model_t* model)
+{
+    uint32_t step   = state->length / model->total;
+    uint32_t target = state->base / step;
+    if (target >= (uint32_t) model->total) target = model->total - 1;
+
+    int low;
+    int s = model_find(model, (int) target, &low);
+    uint32_t X = step * low;
+    uint32_t new_length = s == model->symbols - 1 ? state->length - X : step * model->freq[s];
+
+    decode_interval(in, state, X, new_length);
+    return s;
+}
+
+void encode_value_model(unsigned char* out, const unsigned char* in, size_t size, ac_state_t* state, int increment)
+{
+    ac_model_t model;
+    init_model(&model, state->alphabet_size, increment);
+
+    for (size_t i = 0; i < size; ++i) {
+        encode_character_model(out, in[i], state, &model);
+        update_model(&model, in[i]);
+    }
+
+    select_value(out, state);
+}
+
+int decode_value_model(unsigned char* out, unsigned char* in, size_t in_bits, ac_state_t* state, size_t expected_size, int increment)
+{
+    ac_model_t model;
+    init_model(&model, state->alphabet_size, increment);
 
+    init_decoding(in, in_bits, state);
     for (size_t i = 0; i < expected_size; ++i) {
-        unsigned char decoded_char = decode_character(in, state);
-        *(out++) = decoded_char; 
+        unsigned char decoded_char = decode_character_model(in, state, &model);
+        if (input_overrun(state)) return -1;
+        *(out++) = decoded_char;
+        update_model(&model, decoded_char);
+    }
+    return 0;
+}
+
+int init_context_model(ac_context_model_t* model, int symbols, int order, int increment)
+{
+    assert((symbols == 128 || symbols == AC_MAX_SYMBOLS) && "the context model needs a power of two alphabet");
+    assert(order >= 1 && order <= AC_MAX_ORDER && "unsupported context order");
+
+    size_t contexts = order == 1 ? (size_t) symbols : (size_t) 1 << AC_CONTEXT_HASH_BITS;
+    model->trees = malloc(contexts * symbols * sizeof(uint16_t));
+    if (model->trees == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    // a count of 1 per symbol: node i of the tree covers i & -i symbols
+    for (int i = 1; i <= symbols; ++i) model->trees[i - 1] = (uint16_t) (i & -i);
+    for (size_t c = 1; c < contexts; ++c) {
+        memcpy(model->trees + c * symbols, model->trees, symbols * sizeof(uint16_t));
+    }
+    model->symbols = symbols;
+    model->order = order;
+    model->increment = increment;
+    model->history = 0;
+    return 0;
+}
+
+void free_context_model(ac_context_model_t* model)
+{
+    free(model->trees);
+    model->trees = NULL;
+}
+
+// Counts of the context the previous bytes select
+static uint16_t* context_tree(const ac_context_model_t* model)
+{
+    uint32_t context = model->history & 0xFF;
+    if (model->order == 2) {
+        context = ((model->history & 0xFFFF) * 0x9E3779B1u) >> (32 - AC_CONTEXT_HASH_BITS);
+    }
+    return model->trees + (size_t) context * model->symbols;
+}
+
+static uint32_t context_cumul(const uint16_t* tree, int symbol)
+{
+    uint32_t sum = 0;
+    for (int i = symbol; i > 0; i -= i & -i) sum += tree[i - 1];
+    return sum;
+}
+
+// Same descent as model_find, the total sits at the root tree[symbols - 1]
+static int context_find(const uint16_t* tree, int symbols, uint32_t target, uint32_t* low)
+{
+    int pos = 0;
+    uint32_t sum = 0;
+    for (int step = symbols; step > 0; step >>= 1) {
+        if (pos + step <= symbols && sum + tree[pos + step - 1] <= target) {
+            pos += step;
+            sum += tree[pos - 1];
+        }
+    }
+    *low = sum;
+    return pos;
+}
 
-        // updating prob
-        state->prob_table[decoded_char]++;
-        update_count++;
-
-        // updating cumul table
-        if (update_count >= update_range) {
-            transform_count_to_cumul(state, update_count);
-            // reseting count
-            if (range_clear) {
-                update_count = 0;
-                int j;
-                for (j = 0; j < 128; j++) state->prob_table[j] = 1;
-            };
+static void update_context(ac_context_model_t* model, uint16_t* tree, unsigned char symbol)
+{
+    int n = model->symbols;
+    if (tree[n - 1] + model->increment > CONTEXT_MAX_TOTAL) {
+        // back to plain counts (undo the build in reverse), halve, rebuild
+        for (int i = n; i >= 1; --i) {
+            int parent = i + (i & -i);
+            if (parent <= n) tree[parent - 1] -= tree[i - 1];
+        }
+        for (int i = 0; i < n; ++i) tree[i] = (uint16_t) ((tree[i] + 1) / 2);
+        for (int i = 1; i <= n; ++i) {
+            int parent = i + (i & -i);
+            if (parent <= n) tree[parent - 1] += tree[i - 1];
         }
+    }
+    for (int i = symbol + 1; i <= n; i += i & -i) tree[i - 1] += model->increment;
+    model->history = (model->history << 8) | symbol;
+}
 
+int encode_value_context(unsigned char* out, const unsigned char* in, size_t size, ac_state_t* state, int order, int increment)
+{
+    ac_context_model_t model;
+    if (init_context_model(&model, state->alphabet_size, order, increment) != 0) return -1;
+
+    for (size_t i = 0; i < size; ++i) {
+        uint16_t* tree = context_tree(&model);
+        uint32_t low = context_cumul(tree, in[i]);
+        uint32_t freq = context_cumul(tree, in[i] + 1) - low;
+        encode_counts(out, state, low, freq, tree[model.symbols - 1], in[i] == model.symbols - 1);
+        update_context(&model, tree, in[i]);
+    }
+
+    select_value(out, state);
+    free_context_model(&model);
+    return 0;
+}
+
+int decode_value_context(unsigned char* out, unsigned char* in, size_t in_bits, ac_state_t* state, size_t expected_size, int order, int increment)
+{
+    ac_context_model_t model;
+    if (init_context_model(&model, state->alphabet_size, order, increment) != 0) return -1;
+
+    int result = 0;
+    init_decoding(in, in_bits, state);
+    for (size_t i = 0; i < expected_size; ++i) {
+        uint16_t* tree = context_tree(&model);
+        uint32_t total  = tree[model.symbols - 1];
+        uint32_t step   = state->length / total;
+        uint32_t target = state->base / step;
+        if (target >= total) target = total - 1;
+
+        uint32_t low;
+        int s = context_find(tree, model.symbols, target, &low);
+        uint32_t X = step * low;
+        uint32_t new_length = s == model.symbols - 1 ? state->length - X : step * (context_cumul(tree, s + 1) - low);
+
+        if (decode_interval(in, state, X, new_length) != 0 || input_overrun(state)) {
+            result = -1;
+            break;
+        }
+        out[i] = (unsigned char) s;
+        update_context(&model, tree, (unsigned char) s);
     }
 
+    free_context_model(&model);
+    return result;
 }
 
 /*#ifndef DEBUG
@@ -1,5 +1,15 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest alphabet (a full byte) and coder precision, the interval is kept in 32 bits
+#define AC_MAX_SYMBOLS 256
+#define AC_MAX_PRECISION 32
+// Static and periodic models scale their cumulative tables to 2^AC_TABLE_BITS
+#define AC_TABLE_BITS 16
+// The decoder maps the top AC_LOOKUP_BITS of a cumulative value straight to a symbol
+#define AC_LOOKUP_BITS 12
 
 /** Arithmetic Coding state structure */
 typedef struct
@@ -7,19 +17,64 @@ typedef struct
     int* prob_table;
     int* cumul_table;
     int  frac_size;
+    int  alphabet_size;
     int one_counter;
     int current_index;
-    int out_index;
+    size_t out_index;
     int last_symbol;
     unsigned char current_symbol;
-    int base;
-    int length;
+    uint32_t base;
+    uint32_t length;
+
+    // encoder bit sink: whole 64-bit words are stored, carries resolved by follow bits
+    uint64_t bit_buffer;
+    int bit_count;
+    size_t byte_index;
+    int held_bit;       // last 0 emitted that a carry may still turn into 1, -1 if none
+    int pending_ones;   // 1 bits emitted after held_bit, a carry turns them into 0
+
+    // decoder input length: bits from in_bits on read as 0, and a decoder that
+    // reads more than frac_size of them was given a damaged or truncated stream
+    size_t in_bits;
+
+    // decoder slot table: lowest symbol whose cumulative range reaches into each slot
+    unsigned char lookup_table[1 << AC_LOOKUP_BITS];
 
 } ac_state_t;
 
-void init_state(ac_state_t* state, int precision);
+/** Adaptive frequency model, counts kept in a Fenwick (binary indexed) tree so
+ *  both the per-symbol update and the cumulative lookup are O(log n) */
+typedef struct
+{
+    int freq[AC_MAX_SYMBOLS];
+    int tree[AC_MAX_SYMBOLS + 1];   // 1-based, tree[i] sums freq over (i - (i & -i), i]
+    int symbols;
+    int total;
+    int increment;
+} ac_model_t;
+
+// Lowest precision the Fenwick model can be coded at, leaves room for a 2^16 count total
+#define AC_MODEL_MIN_PRECISION 24
+
+// Highest context order, order-2 contexts are hashed into 2^AC_CONTEXT_HASH_BITS slots
+#define AC_MAX_ORDER 2
+#define AC_CONTEXT_HASH_BITS 10
+
+/** Order-1/order-2 context model: one Fenwick tree of 16-bit counts per
+ *  context, picked by the previous byte or a hash of the previous two. At 256
+ *  symbols order 1 takes 128 KiB and order 2 512 KiB, so the model stays in L2. */
+typedef struct
+{
+    uint16_t* trees;    // contexts * symbols counts, tree i of a context at [i - 1]
+    int symbols;
+    int order;
+    int increment;
+    uint32_t history;   // previous bytes, most recent in the low byte
+} ac_context_model_t;
+
+void init_state(ac_state_t* state, int precision, int alphabet_size);
 
-void build_probability_table(ac_state_t* state, const unsigned char* in, int size);
+void build_probability_table(ac_state_t* state, const unsigned char* in, size_t size);
 
 void reset_uniform_probability(ac_state_t* state);
 
@@ -27,6 +82,11 @@ void transform_count_to_cumul(ac_state_t* state, int size);
 
 void reset_prob_table(ac_state_t* state);
 
+/* Build the decoder slot table from cumul_table. decode_value and
+ * decode_value_with_update do it themselves, callers of decode_character must
+ * call it after every change to cumul_table. */
+void build_lookup_table(ac_state_t* state);
+
 void display_prob_table(ac_state_t* state);
 
 void encode_value(unsigned char* out, const unsigned char* in,size_t size,
@@ -36,18 +96,58 @@ void encode_character(unsigned char* out, unsigned char in, ac_state_t* state);
 
 void select_value(unsigned char* out, ac_state_t* state);
 
-void init_decoding(unsigned char* in, ac_state_t* state);
+// Start decoding in, in_bits long
+void init_decoding(unsigned char* in, size_t in_bits, ac_state_t* state);
 
 unsigned char decode_character( unsigned char* in, ac_state_t* state);
 
-void decode_value(unsigned char* out, unsigned char* in, ac_state_t* state,
+/* The decode_value* functions read in_bits of input and return 0, or -1 when
+ * the input ends too early for expected_size symbols (or, for the context
+ * model, its counts cannot be allocated). */
+int decode_value(unsigned char* out, unsigned char* in, size_t in_bits, ac_state_t* state,
         size_t expected_size);
 
-void encode_value_with_update(unsigned char* out, unsigned char* in,
+/* Adaptive model: starts from a count of 1 per symbol, counts every coded
+ * symbol and rebuilds the cumulative table every update_range symbols
+ * (range_clear restarts the counts after each rebuild). No table is stored,
+ * the decoder must use the same update_range and range_clear. */
+void encode_value_with_update(unsigned char* out, const unsigned char* in,
                     size_t size, ac_state_t* state, int update_range,
                     int range_clear);
                     
-void decode_value_with_update(unsigned char* out, unsigned char* in,
+int decode_value_with_update(unsigned char* out, unsigned char* in, size_t in_bits,
                     ac_state_t* state, size_t expected_size,
                     int update_range, int range_clear);
 
+void init_model(ac_model_t* model, int symbols, int increment);
+
+void update_model(ac_model_t* model, unsigned char symbol);
+
+/* Fenwick model coding: the model is updated after every symbol, increment
+ * sets how fast it adapts. state needs at least AC_MODEL_MIN_PRECISION and an
+ * alphabet of 128 or 256 symbols. */
+void encode_character_model(unsigned char* out, unsigned char in, ac_state_t* state,
+                    const ac_model_t* model);
+
+unsigned char decode_character_model(unsigned char* in, ac_state_t* state,
+                    const ac_model_t* model);
+
+void encode_value_model(unsigned char* out, const unsigned char* in, size_t size,
+                    ac_state_t* state, int increment);
+
+int decode_value_model(unsigned char* out, unsigned char* in, size_t in_bits,
+                    ac_state_t* state, size_t expected_size, int increment);
+
+// Returns 0, or -1 if the counts cannot be allocated
+int init_context_model(ac_context_model_t* model, int symbols, int order, int increment);
+
+void free_context_model(ac_context_model_t* model);
+
+/* Context model coding, same requirements on state as the Fenwick model.
+ * order is 1 or 2, both sides start every context from a count of 1 per symbol.
+ * encode_value_context returns 0, or -1 if the model cannot be allocated. */
+int encode_value_context(unsigned char* out, const unsigned char* in, size_t size,
+                    ac_state_t* state, int order, int increment);
+
+int decode_value_context(unsigned char* out, unsigned char* in, size_t in_bits,
+                    ac_state_t* state, size_t expected_size, int order, int increment);
@@ -0,0 +1,902 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sndfile.h>
+#include <fftw3.h>
+
+#include "audio_cod.h"
+#include "compressify.h"
+#include "container.h"
+#include "stream.h"
+#include "fft_plan.h"
+#include "lpc_cod.h"
+#include "parallel.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Quantization rounds at 0.5 - AUDIO_DEADZONE, small coefficients become 0
+#define AUDIO_DEADZONE 0.2
+// Band steps are stored as u8 indices, step = 2^(index / 4 - 24); 0 is a silent band
+#define AUDIO_STEP_OFFSET 24
+#define AUDIO_STEPS_PER_OCTAVE 4
+// Coefficient symbols from AUDIO_ESCAPE up continue in a LEB128 remainder
+#define AUDIO_ESCAPE 255
+#define AUDIO_MAX_SYMBOL_BYTES 6
+#define AUDIO_MAX_BANDS 64
+// Samples per channel read and coded in parallel at a time
+#define AUDIO_BATCH_SAMPLES (1 << 16)
+// Side to mid energy below which a stereo transform frame is coded as mid/side
+#define AUDIO_MID_SIDE_RATIO 0.25
+
+
+/** MDCT of one frame size, with its scratch buffers and DCT-IV plan */
+typedef struct
+{
+    int size;                   // hop N, frames are 2N samples
+    int band_count;
+    int band_edges[AUDIO_MAX_BANDS + 1];
+    double* window;             // 2N sine window
+    double* fold;               // N, DCT-IV input
+    double* coeffs;             // N, DCT-IV output
+    fftw_plan dct;              // shared through the plan cache, not owned
+} audio_transform_t;
+
+/** Growing output of the coefficient symbols */
+typedef struct
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} byte_buffer_t;
+
+static int reserve(byte_buffer_t* buffer, size_t extra)
+{
+    if (buffer->capacity - buffer->size >= extra) return 0;
+    size_t capacity = buffer->capacity ? 2 * buffer->capacity : 1 << 16;
+    while (capacity - buffer->size < extra) capacity *= 2;
+    unsigned char* grown = realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+// Size of path in bytes, 0 if it cannot be opened
+static uint64_t file_size(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return 0;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    fclose(file);
+    return size > 0 ? (uint64_t) size : 0;
+}
+
+static void free_transform(audio_transform_t* t)
+{
+    fftw_free(t->window);
+    fftw_free(t->fold);
+    fftw_free(t->coeffs);
+    memset(t, 0, sizeof(*t));
+}
+
+static int init_transform(audio_transform_t* t, int frame_bits)
+{
+    memset(t, 0, sizeof(*t));
+    int n = 1 << frame_bits;
+    t->size = n;
+    t->window = fftw_malloc(2 * n * sizeof(double));
+    t->fold = fftw_malloc(n * sizeof(double));
+    t->coeffs = fftw_malloc(n * sizeof(double));
+    if (t->window == NULL || t->fold == NULL || t->coeffs == NULL) {
+        perror("Memory allocation failed");
+        free_transform(t);
+        return -1;
+    }
+    t->dct = cf_fft_plan_r2r(n, FFTW_REDFT11);
+    if (t->dct == NULL) {
+        free_transform(t);
+        return -1;
+    }
+    // sin^2 + cos^2 = 1 across the overlap, the aliasing cancels when frames are added
+    for (int i = 0; i < 2 * n; ++i) t->window[i] = sin(M_PI * (i + 0.5) / (2 * n));
+
+    // 4 coefficients wide at the bottom, then about an eighth of the band start
+    int edge = 0;
+    while (edge < n) {
+        int width = (edge / 8) & ~3;
+        if (width < 4) width = 4;
+        t->band_edges[t->band_count++] = edge;
+        edge = edge + width < n ? edge + width : n;
+    }
+    t->band_edges[t->band_count] = n;
+    return 0;
+}
+
+/* Orthonormal DCT-IV of t->fold into t->coeffs, its own inverse.
+ * FFTW's REDFT11 is 2 * sum x[j] cos(pi / N (j + 1/2) (k + 1/2)). */
+static void dct4(audio_transform_t* t)
+{
+    fftw_execute_r2r(t->dct, t->fold, t->coeffs);
+    double scale = sqrt(0.5 / t->size);
+    for (int k = 0; k < t->size; ++k) t->coeffs[k] *= scale;
+}
+
+// MDCT of 2N samples into t->coeffs: window, fold (a, b, c, d) into (-c_r - d, a - b_r), DCT-IV
+static void mdct(audio_transform_t* t, const double* block)
+{
+    int n = t->size, h = n / 2;
+    const double* w = t->window;
+    for (int i = 0; i < h; ++i) {
+        t->fold[i] = -w[3 * h - 1 - i] * block[3 * h - 1 - i] - w[3 * h + i] * block[3 * h + i];
+        t->fold[h + i] = w[i] * block[i] - w[n - 1 - i] * block[n - 1 - i];
+    }
+    dct4(t);
+}
+
+// Inverse of mdct from t->fold (the coefficients): 2N windowed samples to overlap-add
+static void imdct(audio_transform_t* t, double* block)
+{
+    int n = t->size, h = n / 2;
+    const double* w = t->window;
+    dct4(t);
+    const double* u = t->coeffs;
+    for (int i = 0; i < h; ++i) {
+        block[i] = w[i] * u[h + i];
+        block[h + i] = -w[h + i] * u[n - 1 - i];
+        block[n + i] = -w[n + i] * u[h - 1 - i];
+        block[3 * h + i] = -w[3 * h + i] * u[i];
+    }
+}
+
+// Step of a band as a fraction of its RMS, coarser for lower quality and higher bands
+static double band_step(const audio_transform_t* t, int band, double rms, int quality)
+{
+    double center = 0.5 * (t->band_edges[band] + t->band_edges[band + 1]) / t->size;
+    double relative = pow(2.0, -0.5 * (quality + 1)) * (1.0 + 2.0 * center);
+    // below this the noise is under what the source bit depth carries anyway
+    double floor = pow(2.0, -15.0 + 0.5 * (CF_AUDIO_MAX_QUALITY - quality));
+    double step = rms * relative;
+    return step > floor ? step : floor;
+}
+
+static void put_symbol(byte_buffer_t* out, int value)
+{
+    uint32_t zigzag = value < 0 ? 2 * (uint32_t) -(int64_t) value - 1 : 2 * (uint32_t) value;
+    if (zigzag < AUDIO_ESCAPE) {
+        out->data[out->size++] = (unsigned char) zigzag;
+        return;
+    }
+    out->data[out->size++] = AUDIO_ESCAPE;
+    zigzag -= AUDIO_ESCAPE;
+    while (zigzag >= 0x80) {
+        out->data[out->size++] = (unsigned char) (zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    out->data[out->size++] = (unsigned char) zigzag;
+}
+
+static int get_symbol(const unsigned char** p, const unsigned char* end, int* value)
+{
+    if (*p == end) return -1;
+    uint32_t zigzag = *(*p)++;
+    if (zigzag == AUDIO_ESCAPE) {
+        uint32_t rest = 0;
+        for (int shift = 0;; shift += 7) {
+            if (*p == end || shift > 28) return -1;
+            unsigned char byte = *(*p)++;
+            rest |= (uint32_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (rest > INT32_MAX - AUDIO_ESCAPE) return -1;
+        zigzag = AUDIO_ESCAPE + rest;
+    }
+    *value = zigzag & 1 ? -(int) (zigzag >> 1) - 1 : (int) (zigzag >> 1);
+    return 0;
+}
+
+/* Quantize the MDCT of one 2N sample block into out: per band a u8 step index
+ * (0 for a band quantized to all zeros), then its coefficient symbols */
+static int encode_frame(audio_transform_t* t, const double* block, int quality, byte_buffer_t* out)
+{
+    if (reserve(out, t->band_count + (size_t) t->size * AUDIO_MAX_SYMBOL_BYTES) != 0) return -1;
+    mdct(t, block);
+    for (int b = 0; b < t->band_count; ++b) {
+        const double* c = t->coeffs + t->band_edges[b];
+        int width = t->band_edges[b + 1] - t->band_edges[b];
+        double energy = 0.0, peak = 0.0;
+        for (int i = 0; i < width; ++i) {
+            energy += c[i] * c[i];
+            if (fabs(c[i]) > peak) peak = fabs(c[i]);
+        }
+        double step = band_step(t, b, sqrt(energy / width), quality);
+        int index = (int) lround(AUDIO_STEPS_PER_OCTAVE * (log2(step) + AUDIO_STEP_OFFSET));
+        if (index < 1) index = 1;
+        if (index > 255) index = 255;
+        step = exp2((double) index / AUDIO_STEPS_PER_OCTAVE - AUDIO_STEP_OFFSET);
+        if (peak / step < 0.5 + AUDIO_DEADZONE) {
+            out->data[out->size++] = 0;
+            continue;
+        }
+        out->data[out->size++] = (unsigned char) index;
+        for (int i = 0; i < width; ++i) {
+            double q = floor(fabs(c[i]) / step + 0.5 - AUDIO_DEADZONE);
+            if (q > INT32_MAX / 2) q = INT32_MAX / 2;
+            put_symbol(out, c[i] < 0 ? -(int) q : (int) q);
+        }
+    }
+    return 0;
+}
+
+// Read one frame's symbols back into 2N windowed samples, -1 if they are corrupt
+static int decode_frame(audio_transform_t* t, const unsigned char** p, const unsigned char* end, double* block)
+{
+    for (int b = 0; b < t->band_count; ++b) {
+        double* c = t->fold + t->band_edges[b];
+        int width = t->band_edges[b + 1] - t->band_edges[b];
+        if (*p == end) return -1;
+        int index = *(*p)++;
+        if (index == 0) {
+            memset(c, 0, width * sizeof(double));
+            continue;
+        }
+        double step = exp2((double) index / AUDIO_STEPS_PER_OCTAVE - AUDIO_STEP_OFFSET);
+        for (int i = 0; i < width; ++i) {
+            int q;
+            if (get_symbol(p, end, &q) != 0) return -1;
+            c[i] = q * step;
+        }
+    }
+    imdct(t, block);
+    return 0;
+}
+
+static void write_audio_header(unsigned char* p, int mode, int parameter, int frame_bits, int flags,
+                               const SF_INFO* info)
+{
+    memset(p, 0, CF_AUDIO_HEADER_SIZE);
+    memcpy(p, CF_AUDIO_MAGIC, 4);
+    p[4] = CF_AUDIO_VERSION;
+    p[5] = (unsigned char) mode;
+    p[6] = (unsigned char) parameter;
+    p[7] = (unsigned char) frame_bits;
+    cf_put_u32(p + 8, (uint32_t) info->samplerate);
+    cf_put_u32(p + 12, (uint32_t) info->channels);
+    cf_put_u32(p + 16, (uint32_t) info->format);
+    cf_put_u64(p + 20, (uint64_t) info->frames);
+    cf_put_u32(p + 28, (uint32_t) flags);
+}
+
+static int read_audio_header(const unsigned char* p, size_t size, int* mode, int* parameter, int* frame_bits,
+                             int* flags, SF_INFO* info)
+{
+    if (size < CF_AUDIO_HEADER_SIZE || memcmp(p, CF_AUDIO_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: not a compressify audio file.\n");
+        return -1;
+    }
+    if (p[4] != CF_AUDIO_VERSION || (p[5] != CF_AUDIO_MODE_TRANSFORM && p[5] != CF_AUDIO_MODE_LOSSLESS)) {
+        fprintf(stderr, "Error: unsupported audio file version %d, mode %d.\n", p[4], p[5]);
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    *mode = p[5];
+    *parameter = p[6];
+    *frame_bits = p[7];
+    info->samplerate = (int) cf_get_u32(p + 8);
+    info->channels = (int) cf_get_u32(p + 12);
+    info->format = (int) cf_get_u32(p + 16);
+    info->frames = (sf_count_t) cf_get_u64(p + 20);
+    *flags = (int) cf_get_u32(p + 28);
+    int valid = *mode == CF_AUDIO_MODE_LOSSLESS
+        ? *parameter >= LPC_MIN_BITS && *parameter < LPC_MAX_BITS
+            && *frame_bits >= CF_AUDIO_MIN_LOSSLESS_BLOCK_BITS && *frame_bits <= CF_AUDIO_MAX_LOSSLESS_BLOCK_BITS
+        : *frame_bits >= CF_AUDIO_MIN_FRAME_BITS && *frame_bits <= CF_AUDIO_MAX_FRAME_BITS;
+    if (!valid || info->channels < 1 || info->channels > 256 || info->samplerate < 1 || info->frames < 0
+            || (*flags & ~CF_AUDIO_FLAG_STEREO) || ((*flags & CF_AUDIO_FLAG_STEREO) && info->channels != 2)) {
+        fprintf(stderr, "Error: invalid audio file header.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Bits per sample of the integer PCM formats lossless mode takes, 0 for the others
+static int pcm_bits(int format)
+{
+    switch (format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8: return 8;
+    case SF_FORMAT_PCM_16: return 16;
+    case SF_FORMAT_PCM_24: return 24;
+    default: return 0;
+    }
+}
+
+/** One frame of a batch being coded: its own transform scratch and output */
+typedef struct
+{
+    audio_transform_t transform;
+    double* coupled;            // transform: mid and side blocks of a stereo frame, 4N
+    int32_t* samples;           // lossless: left, right, mid and side of a block, 4N
+    byte_buffer_t symbols;
+    int status;
+} audio_slot_t;
+
+/** Shared state of the frames of one batch */
+typedef struct
+{
+    audio_slot_t* slots;
+    const double* planar;       // transform: per channel, the previous hop and the batch
+    size_t stride;              // transform: samples between channels in planar
+    const int* pcm;             // lossless: the interleaved batch
+    size_t frames;              // lossless: samples per channel in pcm
+    int size;                   // hop or block size
+    int channels;
+    int quality;                // transform quality, lossless bits per sample
+    int stereo;                 // code channel pairs with CF_AUDIO_FLAG_STEREO
+} audio_batch_t;
+
+static void free_slots(audio_slot_t* slots, int count)
+{
+    for (int i = 0; slots != NULL && i < count; ++i) {
+        free_transform(&slots[i].transform);
+        fftw_free(slots[i].coupled);
+        free(slots[i].samples);
+        free(slots[i].symbols.data);
+    }
+    free(slots);
+}
+
+/* count slots, each with a transform of 2^frame_bits if frame_bits > 0 and
+ * lossless scratch of size samples otherwise. NULL (with a message) on failure. */
+static audio_slot_t* alloc_slots(int count, int frame_bits, int size)
+{
+    audio_slot_t* slots = calloc(count, sizeof(audio_slot_t));
+    if (slots == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (frame_bits > 0) {
+            if (init_transform(&slots[i].transform, frame_bits) != 0) {
+                free_slots(slots, count);
+                return NULL;
+            }
+            slots[i].coupled = fftw_malloc((size_t) 4 * slots[i].transform.size * sizeof(double));
+        } else {
+            slots[i].samples = malloc((size_t) 4 * size * sizeof(int32_t));
+        }
+        if (slots[i].coupled == NULL && slots[i].samples == NULL) {
+            perror("Memory allocation failed");
+            free_slots(slots, count);
+            return NULL;
+        }
+    }
+    return slots;
+}
+
+// Append every slot's symbols in frame order, a block goes out whenever CF_AUDIO_BLOCK is reached
+static int write_slots(audio_slot_t* slots, size_t count, byte_buffer_t* symbols, cf_stream_writer_t* writer)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (slots[i].status != 0) return -1;
+        if (reserve(symbols, slots[i].symbols.size) != 0) return -1;
+        memcpy(symbols->data + symbols->size, slots[i].symbols.data, slots[i].symbols.size);
+        symbols->size += slots[i].symbols.size;
+        if (symbols->size >= CF_AUDIO_BLOCK) {
+            if (cf_stream_write_block(writer, symbols->data, symbols->size) != 0) return -1;
+            symbols->size = 0;
+        }
+    }
+    return 0;
+}
+
+/* Frame index of the batch, every channel through encode_frame. A stereo frame
+ * is coded as mid = (left + right) / 2 and side = (left - right) / 2 when the
+ * side has much less energy than the mid, most side bands are then silent. A
+ * wide or panned frame stays left/right, so the quantization noise of the
+ * louder channel is not spread into the quieter one. */
+static void encode_transform_job(void* arg, size_t index)
+{
+    audio_batch_t* batch = arg;
+    audio_slot_t* slot = &batch->slots[index];
+    int n = batch->size;
+    const double* blocks[2];
+    slot->symbols.size = 0;
+    slot->status = -1;
+    if (batch->stereo) {
+        const double* left = batch->planar + index * n;
+        const double* right = left + batch->stride;
+        double* mid = slot->coupled;
+        double* side = slot->coupled + 2 * n;
+        double mid_energy = 0.0, side_energy = 0.0;
+        for (int i = 0; i < 2 * n; ++i) {
+            mid[i] = 0.5 * (left[i] + right[i]);
+            side[i] = 0.5 * (left[i] - right[i]);
+            mid_energy += mid[i] * mid[i];
+            side_energy += side[i] * side[i];
+        }
+        int coupling = side_energy < AUDIO_MID_SIDE_RATIO * mid_energy ? CF_AUDIO_STEREO_MID_SIDE
+                                                                        : CF_AUDIO_STEREO_LEFT_RIGHT;
+        blocks[0] = coupling == CF_AUDIO_STEREO_MID_SIDE ? mid : left;
+        blocks[1] = coupling == CF_AUDIO_STEREO_MID_SIDE ? side : right;
+        if (reserve(&slot->symbols, 1) != 0) return;
+        slot->symbols.data[slot->symbols.size++] = (unsigned char) coupling;
+    }
+    for (int ch = 0; ch < batch->channels; ++ch) {
+        const double* block = batch->stereo ? blocks[ch] : batch->planar + ch * batch->stride + index * n;
+        if (encode_frame(&slot->transform, block, batch->quality, &slot->symbols) != 0) return;
+    }
+    slot->status = 0;
+}
+
+/* Frame f covers samples [(f - 1) N, (f + 1) N), zeros outside the file, and
+ * the frame after the last sample is the last. Hops are read and split into
+ * channels AUDIO_BATCH_SAMPLES at a time, the frames of a batch are coded in
+ * parallel and their symbols joined in order, in blocks of whole frames so the
+ * decoder can start on the first block. */
+static int encode_transform(SNDFILE* in, const SF_INFO* info, int quality, int flags, int threads,
+                            cf_stream_writer_t* writer, uint64_t* frames)
+{
+    int n = CF_AUDIO_FRAME;
+    int hops = AUDIO_BATCH_SAMPLES / n;
+    int channels = info->channels;
+    // per channel the previous hop, the batch and the zeros after the last sample
+    size_t stride = (size_t) (hops + 2) * n;
+    double* pcm = malloc((size_t) hops * n * channels * sizeof(double));
+    double* planar = calloc(stride * channels, sizeof(double));
+    audio_slot_t* slots = alloc_slots(hops + 1, CF_AUDIO_FRAME_BITS, 0);
+    byte_buffer_t symbols = {NULL, 0, 0};
+    int result = -1;
+    if (slots == NULL) goto done;
+    if (pcm == NULL || planar == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    audio_batch_t batch = {slots, planar, stride, NULL, 0, n, channels, quality, flags & CF_AUDIO_FLAG_STEREO};
+    for (;;) {
+        sf_count_t got = sf_readf_double(in, pcm, (sf_count_t) hops * n);
+        if (got < 0) got = 0;
+        *frames += (uint64_t) got;
+        int ended = got < (sf_count_t) hops * n;
+        size_t count = (size_t) ((got + n - 1) / n) + ended;
+        for (int ch = 0; ch < channels; ++ch) {
+            double* samples = planar + ch * stride;
+            for (sf_count_t i = 0; i < got; ++i) samples[n + i] = pcm[(size_t) i * channels + ch];
+            memset(samples + n + got, 0, (stride - n - got) * sizeof(double));
+        }
+        parallel_for(count, threads, encode_transform_job, &batch);
+        if (write_slots(slots, count, &symbols, writer) != 0) goto done;
+        if (ended) break;
+        for (int ch = 0; ch < channels; ++ch) {
+            double* samples = planar + ch * stride;
+            memmove(samples, samples + (size_t) hops * n, n * sizeof(double));
+        }
+    }
+    if (symbols.size > 0 && cf_stream_write_block(writer, symbols.data, symbols.size) != 0) goto done;
+    result = 0;
+
+done:
+    free(symbols.data);
+    free_slots(slots, hops + 1);
+    free(planar);
+    free(pcm);
+    return result;
+}
+
+// Sum of the order 2 fixed residuals, a cheap stand-in for a channel's coded size
+static uint64_t residual_cost(const int32_t* x, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 2; i < n; ++i) {
+        int64_t residual = (int64_t) x[i] - 2 * (int64_t) x[i - 1] + x[i - 2];
+        sum += (uint64_t) (residual < 0 ? -residual : residual);
+    }
+    return sum;
+}
+
+/* Block index of the batch, every channel through lpc_encode_block. Stereo
+ * blocks take whichever of left/right, left/side, side/right and mid/side
+ * predicts smallest, mid = (left + right) >> 1 and side = left - right with
+ * one bit more, and start with a byte naming it. */
+static void encode_lossless_job(void* arg, size_t index)
+{
+    audio_batch_t* batch = arg;
+    audio_slot_t* slot = &batch->slots[index];
+    int n = batch->size;
+    int channels = batch->channels;
+    size_t start = index * n;
+    size_t count = batch->frames - start < (size_t) n ? batch->frames - start : (size_t) n;
+    // libsndfile scales integer reads to 32 bits, the low bits are zero
+    int32_t scale = (int32_t) 1 << (32 - batch->quality);
+    const int* pcm = batch->pcm + start * channels;
+    slot->symbols.size = 0;
+    slot->status = -1;
+    if (reserve(&slot->symbols, 1 + channels * lpc_encode_bound(count)) != 0) return;
+
+    int32_t* left = slot->samples;
+    int32_t* right = left + n;
+    int32_t* mid = right + n;
+    int32_t* side = mid + n;
+    const int32_t* coded[2] = {left, right};
+    int bits[2] = {batch->quality, batch->quality};
+    if (batch->stereo) {
+        for (size_t i = 0; i < count; ++i) {
+            left[i] = pcm[2 * i] / scale;
+            right[i] = pcm[2 * i + 1] / scale;
+            mid[i] = (int32_t) (((int64_t) left[i] + right[i]) >> 1);
+            side[i] = left[i] - right[i];
+        }
+        uint64_t l = residual_cost(left, count), r = residual_cost(right, count);
+        uint64_t m = residual_cost(mid, count), s = residual_cost(side, count);
+        int coupling = CF_AUDIO_STEREO_LEFT_RIGHT;
+        uint64_t best = l + r;
+        if (l + s < best) { coupling = CF_AUDIO_STEREO_LEFT_SIDE; best = l + s; }
+        if (s + r < best) { coupling = CF_AUDIO_STEREO_SIDE_RIGHT; best = s + r; }
+        if (m + s < best) { coupling = CF_AUDIO_STEREO_MID_SIDE; best = m + s; }
+        if (coupling == CF_AUDIO_STEREO_MID_SIDE) coded[0] = mid;
+        if (coupling == CF_AUDIO_STEREO_SIDE_RIGHT) coded[0] = side;
+        if (coupling == CF_AUDIO_STEREO_LEFT_SIDE || coupling == CF_AUDIO_STEREO_MID_SIDE) coded[1] = side;
+        bits[0] += coupling == CF_AUDIO_STEREO_SIDE_RIGHT;
+        bits[1] += coupling == CF_AUDIO_STEREO_LEFT_SIDE || coupling == CF_AUDIO_STEREO_MID_SIDE;
+        slot->symbols.data[slot->symbols.size++] = (unsigned char) coupling;
+    }
+    for (int ch = 0; ch < channels; ++ch) {
+        if (!batch->stereo) {
+            for (size_t i = 0; i < count; ++i) left[i] = pcm[i * channels + ch] / scale;
+        }
+        size_t size = lpc_encode_block(batch->stereo ? coded[ch] : left, count, bits[ch & 1],
+                                       slot->symbols.data + slot->symbols.size);
+        if (size == 0) {
+            perror("Memory allocation failed");
+            return;
+        }
+        slot->symbols.size += size;
+    }
+    slot->status = 0;
+}
+
+/* Every CF_AUDIO_LOSSLESS_BLOCK frames (fewer in the last block) are a block,
+ * coded AUDIO_BATCH_SAMPLES at a time in parallel and joined in order. */
+static int encode_lossless(SNDFILE* in, const SF_INFO* info, int bits, int flags, int threads,
+                           cf_stream_writer_t* writer, uint64_t* frames)
+{
+    int n = CF_AUDIO_LOSSLESS_BLOCK;
+    int blocks = AUDIO_BATCH_SAMPLES / n;
+    int channels = info->channels;
+    int* pcm = malloc((size_t) blocks * n * channels * sizeof(int));
+    audio_slot_t* slots = alloc_slots(blocks, 0, n);
+    byte_buffer_t symbols = {NULL, 0, 0};
+    int result = -1;
+    if (slots == NULL) goto done;
+    if (pcm == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    audio_batch_t batch = {slots, NULL, 0, pcm, 0, n, channels, bits, flags & CF_AUDIO_FLAG_STEREO};
+    for (;;) {
+        sf_count_t got = sf_readf_int(in, pcm, (sf_count_t) blocks * n);
+        if (got <= 0) break;
+        *frames += (uint64_t) got;
+        batch.frames = (size_t) got;
+        size_t count = (size_t) (got + n - 1) / n;
+        parallel_for(count, threads, encode_lossless_job, &batch);
+        if (write_slots(slots, count, &symbols, writer) != 0) goto done;
+        if (got < (sf_count_t) blocks * n) break;
+    }
+    if (symbols.size > 0 && cf_stream_write_block(writer, symbols.data, symbols.size) != 0) goto done;
+    result = 0;
+
+done:
+    free(symbols.data);
+    free_slots(slots, blocks);
+    free(pcm);
+    return result;
+}
+
+int cf_audio_compress(const char* input_file, const char* output_file, int quality, int threads,
+                    cf_audio_stats_t* stats)
+{
+    if (quality != CF_AUDIO_LOSSLESS && (quality < CF_AUDIO_MIN_QUALITY || quality > CF_AUDIO_MAX_QUALITY)) {
+        fprintf(stderr, "Error: audio quality must be %d to %d or %d for lossless, not %d.\n",
+                CF_AUDIO_MIN_QUALITY, CF_AUDIO_MAX_QUALITY, CF_AUDIO_LOSSLESS, quality);
+        return -1;
+    }
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE* in = sf_open(input_file, SFM_READ, &info);
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot read %s: %s\n", input_file, sf_strerror(NULL));
+        return -1;
+    }
+    int lossless = quality == CF_AUDIO_LOSSLESS;
+    int mode = lossless ? CF_AUDIO_MODE_LOSSLESS : CF_AUDIO_MODE_TRANSFORM;
+    int parameter = lossless ? pcm_bits(info.format) : quality;
+    int frame_bits = lossless ? CF_AUDIO_LOSSLESS_BLOCK_BITS : CF_AUDIO_FRAME_BITS;
+    int flags = info.channels == 2 ? CF_AUDIO_FLAG_STEREO : 0;
+    if (parameter == 0) {
+        fprintf(stderr, "Error: lossless audio takes 8, 16 or 24-bit integer PCM, %s is not.\n", input_file);
+        sf_close(in);
+        return -1;
+    }
+
+    FILE* out = NULL;
+    cf_stream_writer_t* writer = NULL;
+    uint64_t frames = 0;
+    int result = -1;
+    out = fopen(output_file, "wb");
+    if (out == NULL) {
+        perror("Error opening output file");
+        goto done;
+    }
+    // the frame count is patched in at the end, the header only guesses it
+    unsigned char header[CF_AUDIO_HEADER_SIZE];
+    write_audio_header(header, mode, parameter, frame_bits, flags, &info);
+    if (fwrite(header, 1, CF_AUDIO_HEADER_SIZE, out) != CF_AUDIO_HEADER_SIZE) {
+        perror("Error writing output");
+        goto done;
+    }
+    // Rice codes leave nothing for a byte codec to find, so lossless blocks are stored
+    writer = cf_stream_writer_open(out, lossless ? CF_CODEC_STORE : CF_CODEC_AUTO, CF_CONTAINER_CHECKSUM);
+    if (writer == NULL) goto done;
+    if (lossless ? encode_lossless(in, &info, parameter, flags, threads, writer, &frames) != 0
+                 : encode_transform(in, &info, quality, flags, threads, writer, &frames) != 0) {
+        goto done;
+    }
+    int closed = cf_stream_writer_close(writer);
+    writer = NULL;
+    if (closed != 0) goto done;
+    if (frames != (uint64_t) info.frames) {
+        info.frames = (sf_count_t) frames;
+        write_audio_header(header, mode, parameter, frame_bits, flags, &info);
+        if (fseek(out, 0, SEEK_SET) != 0 || fwrite(header, 1, CF_AUDIO_HEADER_SIZE, out) != CF_AUDIO_HEADER_SIZE) {
+            fprintf(stderr, "Error: cannot patch the frame count into %s.\n", output_file);
+            goto done;
+        }
+    }
+    result = 0;
+
+done:
+    if (writer != NULL) cf_stream_writer_close(writer);
+    if (out != NULL && fclose(out) != 0) result = -1;
+    if (result == 0 && stats != NULL) {
+        stats->frames = frames;
+        stats->channels = info.channels;
+        stats->samplerate = info.samplerate;
+        stats->input_bytes = file_size(input_file);
+        stats->output_bytes = file_size(output_file);
+    }
+    sf_close(in);
+    return result;
+}
+
+// Frame f completes samples [(f - 1) N, f N) with the second half of frame f - 1
+static int decode_transform(cf_stream_reader_t* reader, SNDFILE* out, const SF_INFO* info, int frame_bits,
+                            int flags, const char* output_file)
+{
+    audio_transform_t t;
+    if (init_transform(&t, frame_bits) != 0) return -1;
+
+    int n = t.size;
+    int channels = info->channels;
+    int stereo = flags & CF_AUDIO_FLAG_STEREO;
+    uint64_t frames = (uint64_t) info->frames;
+    uint64_t frame_count = (frames + n - 1) / n + 1;
+    double* pcm = malloc((size_t) n * channels * sizeof(double));
+    double* overlap = calloc((size_t) n * channels, sizeof(double));
+    double* blocks = malloc((size_t) 2 * n * channels * sizeof(double));
+    cf_buffer_t symbols = {NULL, 0, 0};
+    int result = -1;
+    if (pcm == NULL || overlap == NULL || blocks == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    uint64_t f = 0;
+    int status;
+    while ((status = cf_stream_read_block(reader, &symbols)) > 0) {
+        const unsigned char* p = symbols.data;
+        const unsigned char* end = symbols.data + symbols.size;
+        for (; p != end; ++f) {
+            if (f == frame_count) {
+                fprintf(stderr, "Error: unexpected data after the last audio frame.\n");
+                goto done;
+            }
+            // transform frames are only ever coded as left/right or mid/side
+            int coupling = stereo ? *p++ : CF_AUDIO_STEREO_LEFT_RIGHT;
+            int corrupt = coupling != CF_AUDIO_STEREO_LEFT_RIGHT && coupling != CF_AUDIO_STEREO_MID_SIDE;
+            for (int ch = 0; ch < channels && !corrupt; ++ch) {
+                corrupt = decode_frame(&t, &p, end, blocks + (size_t) 2 * n * ch) != 0;
+            }
+            if (corrupt) {
+                fprintf(stderr, "Error: audio frame %llu is corrupt.\n", (unsigned long long) f);
+                goto done;
+            }
+            if (coupling == CF_AUDIO_STEREO_MID_SIDE) {
+                double* left = blocks;
+                double* right = blocks + 2 * n;
+                for (int i = 0; i < 2 * n; ++i) {
+                    double mid = left[i], side = right[i];
+                    left[i] = mid + side;
+                    right[i] = mid - side;
+                }
+            }
+            for (int ch = 0; ch < channels; ++ch) {
+                const double* block = blocks + (size_t) 2 * n * ch;
+                double* tail = overlap + (size_t) n * ch;
+                for (int i = 0; i < n; ++i) {
+                    double value = tail[i] + block[i];
+                    pcm[(size_t) i * channels + ch] = value > 1.0 ? 1.0 : value < -1.0 ? -1.0 : value;
+                }
+                memcpy(tail, block + n, n * sizeof(double));
+            }
+            uint64_t start = f > 0 ? (f - 1) * n : frames;    // frame 0 only primes the overlap
+            uint64_t count = start < frames ? frames - start : 0;
+            if (count > (uint64_t) n) count = n;
+            if (count > 0 && sf_writef_double(out, pcm, (sf_count_t) count) != (sf_count_t) count) {
+                fprintf(stderr, "Error writing %s: %s\n", output_file, sf_strerror(out));
+                goto done;
+            }
+        }
+        cf_buffer_free(&symbols);
+    }
+    if (status != 0) goto done;
+    if (f != frame_count) {
+        fprintf(stderr, "Error: audio stream ended after %llu of %llu frames.\n",
+                (unsigned long long) f, (unsigned long long) frame_count);
+        goto done;
+    }
+    result = 0;
+
+done:
+    cf_buffer_free(&symbols);
+    free(blocks);
+    free(overlap);
+    free(pcm);
+    free_transform(&t);
+    return result;
+}
+
+static int decode_lossless(cf_stream_reader_t* reader, SNDFILE* out, const SF_INFO* info, int bits,
+                           int block_bits, int flags, const char* output_file)
+{
+    int n = 1 << block_bits;
+    int channels = info->channels;
+    int stereo = flags & CF_AUDIO_FLAG_STEREO;
+    int32_t scale = (int32_t) 1 << (32 - bits);
+    int64_t low = -((int64_t) 1 << (bits - 1)), high = ((int64_t) 1 << (bits - 1)) - 1;
+    uint64_t frames = (uint64_t) info->frames;
+    uint64_t decoded = 0;
+    int* pcm = malloc((size_t) n * channels * sizeof(int));
+    int32_t* samples = malloc((size_t) n * channels * sizeof(int32_t));
+    cf_buffer_t symbols = {NULL, 0, 0};
+    int result = -1;
+    if (pcm == NULL || samples == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    int status;
+    while ((status = cf_stream_read_block(reader, &symbols)) > 0) {
+        const unsigned char* p = symbols.data;
+        const unsigned char* end = symbols.data + symbols.size;
+        while (p != end) {
+            if (decoded == frames) {
+                fprintf(stderr, "Error: unexpected data after the last audio block.\n");
+                goto done;
+            }
+            size_t count = frames - decoded < (uint64_t) n ? (size_t) (frames - decoded) : (size_t) n;
+            int coupling = stereo ? *p++ : CF_AUDIO_STEREO_LEFT_RIGHT;
+            int corrupt = coupling > CF_AUDIO_STEREO_MID_SIDE;
+            for (int ch = 0; ch < channels && !corrupt; ++ch) {
+                // the side channel carries one bit more
+                int side = (ch == 0 && coupling == CF_AUDIO_STEREO_SIDE_RIGHT)
+                        || (ch == 1 && (coupling == CF_AUDIO_STEREO_LEFT_SIDE || coupling == CF_AUDIO_STEREO_MID_SIDE));
+                size_t used;
+                corrupt = lpc_decode_block(p, (size_t) (end - p), count, bits + side, samples + (size_t) ch * n, &used) != 0;
+                p += used;
+            }
+            if (corrupt) {
+                fprintf(stderr, "Error: audio block at frame %llu is corrupt.\n", (unsigned long long) decoded);
+                goto done;
+            }
+            int32_t* first = samples;
+            int32_t* second = samples + n;
+            for (size_t i = 0; stereo && i < count; ++i) {
+                int64_t a = first[i], b = second[i];
+                int64_t left = a, right = b;
+                if (coupling == CF_AUDIO_STEREO_LEFT_SIDE) right = a - b;
+                if (coupling == CF_AUDIO_STEREO_SIDE_RIGHT) left = a + b;
+                if (coupling == CF_AUDIO_STEREO_MID_SIDE) {
+                    // the bit mid lost is the low bit of side
+                    int64_t sum = 2 * a + (b & 1);
+                    left = (sum + b) >> 1;
+                    right = (sum - b) >> 1;
+                }
+                if (left < low || left > high || right < low || right > high) {
+                    fprintf(stderr, "Error: audio block at frame %llu is corrupt.\n", (unsigned long long) decoded);
+                    goto done;
+                }
+                first[i] = (int32_t) left;
+                second[i] = (int32_t) right;
+            }
+            // in range after the checks above, so this cannot overflow
+            for (int ch = 0; ch < channels; ++ch) {
+                const int32_t* channel = samples + (size_t) ch * n;
+                for (size_t i = 0; i < count; ++i) pcm[i * channels + ch] = channel[i] * scale;
+            }
+            if (sf_writef_int(out, pcm, (sf_count_t) count) != (sf_count_t) count) {
+                fprintf(stderr, "Error writing %s: %s\n", output_file, sf_strerror(out));
+                goto done;
+            }
+            decoded += count;
+        }
+        cf_buffer_free(&symbols);
+    }
+    if (status != 0) goto done;
+    if (decoded != frames) {
+        fprintf(stderr, "Error: audio stream ended after %llu of %llu frames.\n",
+                (unsigned long long) decoded, (unsigned long long) frames);
+        goto done;
+    }
+    result = 0;
+
+done:
+    cf_buffer_free(&symbols);
+    free(samples);
+    free(pcm);
+    return result;
+}
+
+int cf_audio_decompress(const char* input_file, const char* output_file, cf_audio_stats_t* stats)
+{
+    FILE* in = fopen(input_file, "rb");
+    if (in == NULL) {
+        perror("Error opening input file");
+        return -1;
+    }
+    unsigned char header[CF_AUDIO_HEADER_SIZE];
+    SF_INFO info;
+    int mode, parameter, frame_bits, flags;
+    size_t header_size = fread(header, 1, CF_AUDIO_HEADER_SIZE, in);
+    if (read_audio_header(header, header_size, &mode, &parameter, &frame_bits, &flags, &info) != 0) {
+        fclose(in);
+        return -1;
+    }
+
+    cf_stream_reader_t* reader = NULL;
+    SNDFILE* out = NULL;
+    int result = -1;
+    reader = cf_stream_reader_open(in, 0, 1);
+    if (reader == NULL) goto done;
+    SF_INFO format = info;
+    format.frames = 0;
+    if (!sf_format_check(&format)) {
+        // keep every bit of a lossless file
+        int subtype = mode == CF_AUDIO_MODE_LOSSLESS && parameter > 16 ? SF_FORMAT_PCM_24 : SF_FORMAT_PCM_16;
+        format.format = SF_FORMAT_WAV | subtype;
+    }
+    out = sf_open(output_file, SFM_WRITE, &format);
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot write %s: %s\n", output_file, sf_strerror(NULL));
+        goto done;
+    }
+    result = mode == CF_AUDIO_MODE_LOSSLESS
+        ? decode_lossless(reader, out, &info, parameter, frame_bits, flags, output_file)
+        : decode_transform(reader, out, &info, frame_bits, flags, output_file);
+
+done:
+    if (out != NULL && sf_close(out) != 0) result = -1;
+    if (result == 0 && stats != NULL) {
+        stats->frames = (uint64_t) info.frames;
+        stats->channels = info.channels;
+        stats->samplerate = info.samplerate;
+        stats->input_bytes = file_size(input_file);
+        stats->output_bytes = file_size(output_file);
+    }
+    if (reader != NULL) cf_stream_reader_close(reader);
+    fclose(in);
+    return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lossy transform coding (CF_AUDIO_MODE_TRANSFORM): every channel is cut into sine-windowed MDCT frames
+ * of 2 * CF_AUDIO_FRAME samples overlapping by half. The coefficients of each
+ * frame are split into bands, every band is quantized with one step size set
+ * by its energy and the quality, and the quantized values are entropy coded
+ * through a stream container (stream.h) with a codec picked per block.
+ * Lossless coding (CF_AUDIO_MODE_LOSSLESS) reads the integer PCM instead and
+ * codes every block of each channel with a linear predictor and Rice coded
+ * residuals (lpc_cod.h), which decodes to the same samples bit for bit.
+ * Both modes code the channels of a stereo file as mid/side or one of them
+ * and a side where that is smaller. Frames are coded in parallel batches and
+ * joined in order, decoding runs one block at a time, and memory does not grow
+ * with the length.
+ *
+ * File layout (little endian): "CPFA", u8 version, u8 mode, u8 quality (bits
+ * per sample when lossless), u8 log2 frame size (block size when lossless),
+ * u32 sample rate, u32 channels, u32 libsndfile format, u64 frames per
+ * channel, u32 flags, then the container. With
+ * CF_AUDIO_FLAG_STEREO every frame or block starts with a CF_AUDIO_STEREO_*
+ * byte naming the two channels that follow. */
+#define CF_AUDIO_MAGIC "CPFA"
+#define CF_AUDIO_VERSION 1
+#define CF_AUDIO_HEADER_SIZE 32
+#define CF_AUDIO_MODE_TRANSFORM 0
+#define CF_AUDIO_MODE_LOSSLESS 1
+#define CF_AUDIO_FLAG_STEREO 0x1
+#define CF_AUDIO_STEREO_LEFT_RIGHT 0
+#define CF_AUDIO_STEREO_LEFT_SIDE 1
+#define CF_AUDIO_STEREO_SIDE_RIGHT 2
+#define CF_AUDIO_STEREO_MID_SIDE 3
+// Hop size in samples per channel, the MDCT frame is twice as long
+#define CF_AUDIO_FRAME_BITS 10
+#define CF_AUDIO_FRAME (1 << CF_AUDIO_FRAME_BITS)
+#define CF_AUDIO_MIN_FRAME_BITS 8
+#define CF_AUDIO_MAX_FRAME_BITS 12
+// Coded symbols are flushed as a container block once they reach this size
+#define CF_AUDIO_BLOCK (1 << 20)
+// Quality knob: each step halves the band noise power, 1 is smallest, 10 near transparent
+#define CF_AUDIO_MIN_QUALITY 1
+#define CF_AUDIO_MAX_QUALITY 10
+#define CF_AUDIO_QUALITY 5
+// Quality that selects lossless mode
+#define CF_AUDIO_LOSSLESS 0
+// Samples per channel in one lossless block
+#define CF_AUDIO_LOSSLESS_BLOCK_BITS 12
+#define CF_AUDIO_LOSSLESS_BLOCK (1 << CF_AUDIO_LOSSLESS_BLOCK_BITS)
+#define CF_AUDIO_MIN_LOSSLESS_BLOCK_BITS 8
+#define CF_AUDIO_MAX_LOSSLESS_BLOCK_BITS 16
+
+/** Sizes reported by the audio functions */
+typedef struct
+{
+    uint64_t frames;            // samples per channel
+    int channels;
+    int samplerate;
+    uint64_t input_bytes;       // size of the file read
+    uint64_t output_bytes;      // size of the file written
+} cf_audio_stats_t;
+
+/* Code any file libsndfile reads into output_file at quality (1 .. 10), or
+ * losslessly at CF_AUDIO_LOSSLESS, which takes 8, 16 or 24-bit integer PCM
+ * only. Frames are coded on threads workers (<= 0 uses one per core), the
+ * output is the same for any count. stats may be NULL. Returns 0 on success
+ * or -1 on failure. */
+int cf_audio_compress(const char* input_file, const char* output_file, int quality, int threads,
+                    cf_audio_stats_t* stats);
+
+/* Decode a cf_audio_compress file into output_file, in the format of the
+ * original when libsndfile can write it and 16-bit WAV otherwise.
+ * Returns 0 on success or -1 on failure. */
+int cf_audio_decompress(const char* input_file, const char* output_file, cf_audio_stats_t* stats);
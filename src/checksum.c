@@ -0,0 +1,130 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <pthread.h>
+
+#include "checksum.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+// Same as the rANS kernels: compiled per function, picked at run time, 64-bit only for crc32 on u64
+#define CRC_X86_SSE42 1
+#endif
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+// table[k][b] is the CRC of byte b followed by k zero bytes, 8 bytes per step
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+
+static void build_crc_table(void)
+{
+    for (int b = 0; b < 256; ++b) {
+        uint32_t crc = (uint32_t) b;
+        for (int k = 0; k < 8; ++k) crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc_table[0][b] = crc;
+    }
+    for (int b = 0; b < 256; ++b) {
+        for (int k = 1; k < 8; ++k) {
+            uint32_t prev = crc_table[k - 1][b];
+            crc_table[k][b] = (prev >> 8) ^ crc_table[0][prev & 0xFF];
+        }
+    }
+}
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char* p, size_t size)
+{
+    pthread_once(&crc_table_once, build_crc_table);
+    while (size >= 8) {
+        uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+        uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF]
+            ^ crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24]
+            ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF]
+            ^ crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- > 0) crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#ifdef CRC_X86_SSE42
+/* Three independent crc32 chains hide the instruction's 3-cycle latency, the
+ * chains are joined by running the zero-extended partial CRCs through
+ * crc32_shift, a table multiply by x^(8 * length) mod P. */
+#define CRC_CHAIN (1 << 12)
+
+// crc * x^(8 * CRC_CHAIN) mod P, as a table per byte of the crc
+static uint32_t crc_shift_table[4][256];
+static pthread_once_t crc_shift_once = PTHREAD_ONCE_INIT;
+
+// a * b mod P with both reflected
+static uint32_t crc_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (int i = 0; i < 32; ++i) {
+        if (a & 0x80000000u) product ^= b;
+        a <<= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+static void build_crc_shift_table(void)
+{
+    // x^(8 * CRC_CHAIN), squaring x^1 up from the reflected 1 (0x80000000)
+    uint32_t power = 0x40000000u;   // x^1
+    for (int n = 1; n < 8 * CRC_CHAIN; n <<= 1) power = crc_multiply(power, power);
+    for (int k = 0; k < 4; ++k) {
+        for (int b = 0; b < 256; ++b) crc_shift_table[k][b] = crc_multiply((uint32_t) b << (8 * k), power);
+    }
+}
+
+static uint32_t crc_shift(uint32_t crc)
+{
+    return crc_shift_table[0][crc & 0xFF] ^ crc_shift_table[1][(crc >> 8) & 0xFF]
+         ^ crc_shift_table[2][(crc >> 16) & 0xFF] ^ crc_shift_table[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t size)
+{
+    uint64_t c0 = crc;
+    if (size >= 3 * CRC_CHAIN) pthread_once(&crc_shift_once, build_crc_shift_table);
+    while (size >= 3 * CRC_CHAIN) {
+        uint64_t c1 = 0, c2 = 0;
+        for (size_t i = 0; i < CRC_CHAIN; i += 8) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p + CRC_CHAIN + i, 8);
+            memcpy(&w2, p + 2 * CRC_CHAIN + i, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        c0 = crc_shift(crc_shift((uint32_t) c0) ^ (uint32_t) c1) ^ (uint32_t) c2;
+        p += 3 * CRC_CHAIN;
+        size -= 3 * CRC_CHAIN;
+    }
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c0 = _mm_crc32_u64(c0, w);
+    }
+    uint32_t c = (uint32_t) c0;
+    while (size-- > 0) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+uint32_t cf_crc32c(uint32_t crc, const void* data, size_t size)
+{
+    crc = ~crc;
+#ifdef CRC_X86_SSE42
+    if (__builtin_cpu_supports("sse4.2")) return ~crc32c_sse42(crc, data, size);
+#endif
+    return ~crc32c_table(crc, data, size);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC32C (Castagnoli) of size bytes, continuing from crc (0 to start).
+ * Uses the SSE4.2 crc32 instruction when the CPU has it (checked at run time)
+ * and a sliced table otherwise, the result is the same. */
+uint32_t cf_crc32c(uint32_t crc, const void* data, size_t size);
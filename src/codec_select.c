@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "codec_select.h"
+
+// Context trials are skipped unless order-1 entropy is at least this much lower
+#define CF_ORDER1_MIN_GAIN 0.25
+
+
+// Entropy in bits per symbol of count symbols with these frequencies
+static double entropy(const uint32_t* counts, int symbols, uint64_t count)
+{
+    if (count == 0) return 0.0;
+    double sum = 0.0;
+    for (int i = 0; i < symbols; ++i) {
+        if (counts[i]) sum += counts[i] * log2((double) counts[i]);
+    }
+    return log2((double) count) - sum / count;
+}
+
+// Order-0 and order-1 entropy of the sample, contexts restart at every block
+static int sample_entropy(const unsigned char* sample, size_t size, size_t block_size,
+                    double* order0, double* order1)
+{
+    uint32_t counts[256] = {0};
+    uint32_t* pairs = calloc(256 * 256, sizeof(uint32_t));
+    if (pairs == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        counts[sample[i]]++;
+        if (i % block_size) pairs[sample[i - 1] << 8 | sample[i]]++;
+    }
+
+    *order0 = entropy(counts, 256, size);
+    double bits = 0.0;
+    uint64_t coded = 0;
+    for (int context = 0; context < 256; ++context) {
+        uint64_t total = 0;
+        for (int i = 0; i < 256; ++i) total += pairs[context << 8 | i];
+        bits += total * entropy(pairs + (context << 8), 256, total);
+        coded += total;
+    }
+    *order1 = coded ? bits / coded : *order0;
+    free(pairs);
+    return 0;
+}
+
+// Output of codec on the sample in bits per byte, -1 if it failed
+static double trial_bits(cf_codec_t codec, const unsigned char* sample, size_t size)
+{
+    cf_buffer_t out;
+    if (cf_compress(codec, sample, size, &out) != 0) return -1.0;
+    double bits = (double) out.bits / size;
+    cf_buffer_free(&out);
+    return bits;
+}
+
+cf_codec_t cf_select_codec(const unsigned char* in, size_t size, cf_codec_estimate_t* estimate)
+{
+    cf_codec_estimate_t local;
+    if (estimate == NULL) estimate = &local;
+    memset(estimate, 0, sizeof(*estimate));
+    if (size == 0) return CF_CODEC_STORE;
+
+    // the trials cost one coding pass over the sample, keep it a fraction of the input
+    const unsigned char* sample = in;
+    size_t sample_size = size;
+    size_t block_size = size / ((size_t) CF_SAMPLE_BLOCKS * CF_SAMPLE_FRACTION);
+    if (block_size > CF_SAMPLE_BLOCK_SIZE) block_size = CF_SAMPLE_BLOCK_SIZE;
+    unsigned char* copy = NULL;
+    if (block_size < CF_SAMPLE_MIN_BLOCK) {
+        // too small to split, and cheap to code whole
+        block_size = size;
+    } else {
+        sample_size = (size_t) CF_SAMPLE_BLOCKS * block_size;
+        copy = malloc(sample_size);
+        if (copy == NULL) {
+            perror("Memory allocation failed");
+            return CF_CODEC_RANS;
+        }
+        size_t stride = (size - block_size) / (CF_SAMPLE_BLOCKS - 1);
+        for (size_t i = 0; i < CF_SAMPLE_BLOCKS; ++i) {
+            memcpy(copy + i * block_size, in + i * stride, block_size);
+        }
+        sample = copy;
+    }
+    estimate->sample_size = sample_size;
+
+    cf_codec_t codec = CF_CODEC_RANS;
+    if (sample_entropy(sample, sample_size, block_size, &estimate->order0_entropy, &estimate->order1_entropy) == 0
+            && (estimate->rans_bits = trial_bits(CF_CODEC_RANS, sample, sample_size)) >= 0) {
+        double best = estimate->rans_bits;
+        // the context model is roughly ten times slower, only try it where contexts help
+        if (estimate->order1_entropy <= estimate->order0_entropy - CF_ORDER1_MIN_GAIN) {
+            estimate->context_bits = trial_bits(CF_CODEC_CONTEXT, sample, sample_size);
+            if (estimate->context_bits >= 0 && estimate->context_bits < best * (1.0 - CF_CONTEXT_MIN_GAIN)) {
+                codec = CF_CODEC_CONTEXT;
+                best = estimate->context_bits;
+            }
+        }
+        if (best >= 8.0 * CF_STORE_THRESHOLD) codec = CF_CODEC_STORE;
+    }
+    free(copy);
+    return codec;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "compressify.h"
+
+// Sample taken by cf_select_codec: this many blocks spread over the input, each
+// at most CF_SAMPLE_BLOCK_SIZE and together at most 1/CF_SAMPLE_FRACTION of it.
+// Inputs too small for CF_SAMPLE_MIN_BLOCK blocks are sampled whole.
+#define CF_SAMPLE_BLOCKS 8
+#define CF_SAMPLE_BLOCK_SIZE (16 << 10)
+#define CF_SAMPLE_MIN_BLOCK 512
+#define CF_SAMPLE_FRACTION 8
+// The context model must beat rANS by this fraction to be worth its lower speed
+#define CF_CONTEXT_MIN_GAIN 0.10
+// Coded data must be below this fraction of the input, otherwise it is stored
+#define CF_STORE_THRESHOLD 0.97
+
+/** What cf_select_codec measured on its sample, sizes in bits per input byte */
+typedef struct
+{
+    size_t sample_size;
+    double order0_entropy;
+    double order1_entropy;
+    double rans_bits;           // trial rANS output of the sample
+    double context_bits;        // trial context model output, 0 if not tried
+} cf_codec_estimate_t;
+
+/* Pick the codec for in from a sample of CF_SAMPLE_BLOCKS blocks:
+ * CF_CODEC_STORE if even order-0 coding saves next to nothing, CF_CODEC_CONTEXT
+ * if a trial run of it beats rANS by CF_CONTEXT_MIN_GAIN, CF_CODEC_RANS
+ * otherwise. Huffman is never picked, rANS codes the same counts closer to the
+ * entropy and faster. estimate may be NULL. Costs a small, fixed fraction of
+ * one full pass; on failure (out of memory) it falls back to CF_CODEC_RANS. */
+cf_codec_t cf_select_codec(const unsigned char* in, size_t size, cf_codec_estimate_t* estimate);
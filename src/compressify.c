@@ -0,0 +1,606 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "compressify.h"
+#include "parallel.h"
+#include "huff_cod.h"
+#include "arith_cod.h"
+#include "rans_cod.h"
+
+// .arc layout: u64 original size, u8 model, u8 range_clear (the order for the
+// context model), u32 update_range (the increment for the Fenwick and context
+// models), u8 alphabet bits, u8 coder precision,
+// the static model's u16 cumulative table, then the coded bits
+#define ARITH_HEADER_SIZE (8 + 1 + 1 + 4 + 1 + 1)
+// Coder precision written by the encoder, the decoder takes any from the header
+#define ARITH_PRECISION 32
+#define ARITH_MODEL_STATIC 0
+#define ARITH_MODEL_ADAPTIVE 1
+#define ARITH_MODEL_FENWICK 2
+#define ARITH_MODEL_CONTEXT 3
+// .rns layout: u64 original size, u8 ways (1 for the byte-wise coder), rANS
+// frequency table, then the coded bytes
+#define RANS_HEADER_SIZE 9
+// Largest Huffman block, keeps every coded block length within the u32 index
+#define CF_MAX_BLOCK_SIZE (1 << 28)
+
+
+void cf_buffer_free(cf_buffer_t* buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->bits = 0;
+}
+
+void cf_put_u32(unsigned char* p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) p[i] = (unsigned char) (value >> (8 * i));
+}
+
+uint32_t cf_get_u32(const unsigned char* p)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+void cf_put_u64(unsigned char* p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) p[i] = (unsigned char) (value >> (8 * i));
+}
+
+uint64_t cf_get_u64(const unsigned char* p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+/* .huf layout (little endian):
+ *   u64 original size, u32 block size, serialized tree,
+ *   u32 coded length of every block, then the coded blocks back to back */
+typedef struct
+{
+    const unsigned char* in;
+    size_t size;
+    size_t block_size;
+    uint64_t (*counts)[256];
+    huffman_table_t* table;
+    unsigned char** blocks;
+    size_t* lengths;
+    int* status;
+    unsigned char* out;
+} huffman_job_t;
+
+static size_t block_length(const huffman_job_t* job, size_t index)
+{
+    size_t start = index * job->block_size;
+    return job->size - start < job->block_size ? job->size - start : job->block_size;
+}
+
+static void huffman_count_job(void* arg, size_t index)
+{
+    huffman_job_t* job = arg;
+    huffman_count(job->in + index * job->block_size, block_length(job, index), job->counts[index]);
+}
+
+static void huffman_encode_job(void* arg, size_t index)
+{
+    huffman_job_t* job = arg;
+    size_t length = block_length(job, index);
+    job->blocks[index] = malloc(huffman_block_bound(job->table, length));
+    if (job->blocks[index] == NULL) return;
+    job->lengths[index] = huffman_encode_block(job->table, job->in + index * job->block_size,
+                                               length, job->blocks[index]);
+}
+
+static void huffman_decode_job(void* arg, size_t index)
+{
+    huffman_job_t* job = arg;
+    job->status[index] = huffman_decode_block(job->table, job->blocks[index], job->lengths[index],
+                                              job->out + index * job->block_size,
+                                              block_length(job, index));
+}
+
+int huffman_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    return huffman_compress_blocks(in, size, CF_BLOCK_SIZE, 0, out);
+}
+
+int huffman_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    return huffman_decompress_blocks(in, size, 0, out);
+}
+
+int huffman_compress_blocks(const unsigned char* in, size_t size, size_t block_size,
+                    int threads, cf_buffer_t* out)
+{
+    if (block_size == 0) block_size = CF_BLOCK_SIZE;
+    if (block_size > CF_MAX_BLOCK_SIZE) block_size = CF_MAX_BLOCK_SIZE;
+    size_t block_count = (size + block_size - 1) / block_size;
+
+    huffman_job_t job = {in, size, block_size, NULL, NULL, NULL, NULL, NULL, NULL};
+    job.counts  = calloc(block_count + 1, sizeof(*job.counts));
+    job.blocks  = calloc(block_count + 1, sizeof(unsigned char*));
+    job.lengths = calloc(block_count + 1, sizeof(size_t));
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    if (job.counts == NULL || job.blocks == NULL || job.lengths == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+
+    // one table for the whole input, built from per-block counts gathered in parallel
+    parallel_for(block_count, threads, huffman_count_job, &job);
+    uint64_t counts[256] = {0};
+    for (size_t i = 0; i < block_count; ++i) {
+        for (int c = 0; c < 256; ++c) counts[c] += job.counts[i][c];
+    }
+    job.table = huffman_build_table(counts);
+    if (job.table == NULL) goto done;
+
+    parallel_for(block_count, threads, huffman_encode_job, &job);
+
+    size_t total = 12 + HUFFMAN_MAX_TABLE_BYTES + 4 * block_count;
+    for (size_t i = 0; i < block_count; ++i) {
+        if (job.blocks[i] == NULL) {
+            perror("Memory allocation failed");
+            goto done;
+        }
+        total += job.lengths[i];
+    }
+
+    out->data = malloc(total);
+    if (out->data == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    unsigned char* p = out->data;
+    cf_put_u64(p, size);
+    cf_put_u32(p + 8, (uint32_t) block_size);
+    p += 12;
+    if (size > 0) p += huffman_write_table(job.table, p);
+    for (size_t i = 0; i < block_count; ++i, p += 4) cf_put_u32(p, (uint32_t) job.lengths[i]);
+    for (size_t i = 0; i < block_count; ++i) {
+        memcpy(p, job.blocks[i], job.lengths[i]);
+        p += job.lengths[i];
+    }
+    out->size = p - out->data;
+    // only the last block's padding is left at the end
+    out->bits = 8 * (uint64_t) out->size;
+    if (block_count > 0) {
+        out->bits -= 8 * (uint64_t) job.lengths[block_count - 1]
+                     - huffman_coded_bits(job.table, job.counts[block_count - 1]);
+    }
+
+done:
+    for (size_t i = 0; job.blocks && i < block_count; ++i) free(job.blocks[i]);
+    huffman_free_table(job.table);
+    free(job.counts);
+    free(job.blocks);
+    free(job.lengths);
+    return out->data ? 0 : -1;
+}
+
+int huffman_decompress_blocks(const unsigned char* in, size_t size, int threads,
+                    cf_buffer_t* out)
+{
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    if (size < 12) {
+        fprintf(stderr, "Error: Huffman stream is shorter than its header.\n");
+        return -1;
+    }
+    uint64_t original_size = cf_get_u64(in);
+    size_t block_size = cf_get_u32(in + 8);
+    if (original_size > 0 && (block_size == 0 || original_size > SIZE_MAX - block_size)) {
+        fprintf(stderr, "Error: invalid Huffman block header.\n");
+        return -1;
+    }
+
+    huffman_job_t job = {NULL, original_size, block_size, NULL, NULL, NULL, NULL, NULL, NULL};
+    size_t block_count = original_size > 0 ? (original_size + block_size - 1) / block_size : 0;
+    size_t pos = 12;
+    int result = -1;
+
+    if (block_count > 0) {
+        size_t table_size = 0;
+        job.table = huffman_read_table(in + pos, size - pos, &table_size);
+        if (job.table == NULL) return -1;
+        pos += table_size;
+    }
+    if (block_count > (size - pos) / 4) {
+        fprintf(stderr, "Error: Huffman block index is truncated.\n");
+        goto done;
+    }
+
+    job.blocks  = calloc(block_count + 1, sizeof(unsigned char*));
+    job.lengths = calloc(block_count + 1, sizeof(size_t));
+    job.status  = calloc(block_count + 1, sizeof(int));
+    out->data   = malloc(original_size + 1);
+    if (job.blocks == NULL || job.lengths == NULL || job.status == NULL || out->data == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+
+    // prefix sums of the index give every block its own offset, so blocks decode independently
+    size_t offset = pos + 4 * block_count;
+    for (size_t i = 0; i < block_count; ++i) {
+        job.lengths[i] = cf_get_u32(in + pos + 4 * i);
+        if (job.lengths[i] > size - offset) {
+            fprintf(stderr, "Error: Huffman block %zu is truncated.\n", i);
+            goto done;
+        }
+        job.blocks[i] = (unsigned char*) in + offset;
+        offset += job.lengths[i];
+    }
+
+    job.out = out->data;
+    parallel_for(block_count, threads, huffman_decode_job, &job);
+    result = 0;
+    for (size_t i = 0; i < block_count; ++i) {
+        if (job.status[i] != 0) {
+            fprintf(stderr, "Error: Huffman block %zu is corrupt.\n", i);
+            result = -1;
+        }
+    }
+    out->size = original_size;
+    out->bits = 8 * (uint64_t) original_size;
+
+done:
+    if (result != 0) cf_buffer_free(out);
+    huffman_free_table(job.table);
+    free(job.blocks);
+    free(job.lengths);
+    free(job.status);
+    return result;
+}
+
+static int arithmetic_encode(const unsigned char* in, size_t size, int model,
+                    int update_range, int range_clear, cf_buffer_t* out)
+{
+    // 7-bit input (ASCII text) gets the smaller alphabet, anything else all 256 byte values
+    int symbol_bits = 7;
+    for (size_t i = 0; i < size; i++) {
+        if (in[i] >= 128) {
+            symbol_bits = 8;
+            break;
+        }
+    }
+    if (update_range < 1 || (model >= ARITH_MODEL_FENWICK && update_range > CF_MAX_MODEL_INCREMENT)) {
+        fprintf(stderr, "Error: adaptive update range or increment out of range.\n");
+        return -1;
+    }
+    if (model == ARITH_MODEL_CONTEXT && (range_clear < 1 || range_clear > AC_MAX_ORDER)) {
+        fprintf(stderr, "Error: context order must be 1 or %d.\n", AC_MAX_ORDER);
+        return -1;
+    }
+
+    // 預估大小: no symbol costs more than about 16 bits, plus rounding slack
+    size_t output_size = size * 2 + size / 8 + 16;
+    unsigned char* output = calloc(output_size, 1);
+    if (output == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+
+    // initialize the encoder state
+    ac_state_t encoder_state;
+    init_state(&encoder_state, ARITH_PRECISION, 1 << symbol_bits);
+
+    size_t table_size = 0;
+    if (model == ARITH_MODEL_CONTEXT) {
+        if (encode_value_context(output, in, size, &encoder_state, range_clear, update_range) != 0) {
+            free(encoder_state.prob_table);
+            free(encoder_state.cumul_table);
+            free(output);
+            return -1;
+        }
+    } else if (model == ARITH_MODEL_FENWICK) {
+        encode_value_model(output, in, size, &encoder_state, update_range);
+    } else if (model == ARITH_MODEL_ADAPTIVE) {
+        encode_value_with_update(output, in, size, &encoder_state, update_range, range_clear);
+    } else {
+        // build the probability table
+        build_probability_table(&encoder_state, in, size);
+        encode_value(output, in, size, &encoder_state);
+        table_size = 2 << symbol_bits;
+    }
+
+    // the coder reports its length in bits, so 0x00 bytes inside the payload are kept
+    size_t payload_size = (encoder_state.out_index + 7) / 8;
+    out->size = ARITH_HEADER_SIZE + table_size + payload_size;
+    out->bits = 8 * (uint64_t) (ARITH_HEADER_SIZE + table_size) + encoder_state.out_index;
+    out->data = malloc(out->size);
+    if (out->data != NULL) {
+        unsigned char* p = out->data;
+        cf_put_u64(p, size);
+        p[8] = (unsigned char) model;
+        p[9] = (unsigned char) (model == ARITH_MODEL_CONTEXT ? range_clear : range_clear != 0);
+        cf_put_u32(p + 10, (uint32_t) update_range);
+        p[14] = (unsigned char) symbol_bits;
+        p[15] = ARITH_PRECISION;
+        p += ARITH_HEADER_SIZE;
+        for (size_t i = 0; i < table_size / 2; i++, p += 2) {
+            p[0] = (unsigned char) encoder_state.cumul_table[i];
+            p[1] = (unsigned char) (encoder_state.cumul_table[i] >> 8);
+        }
+        memcpy(p, output, payload_size);
+    } else {
+        perror("Memory allocation failed");
+        out->size = 0;
+        out->bits = 0;
+    }
+
+    free(encoder_state.prob_table);
+    free(encoder_state.cumul_table);
+    free(output);
+    return out->data ? 0 : -1;
+}
+
+int arithmetic_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    return arithmetic_encode(in, size, ARITH_MODEL_STATIC, 1, 0, out);
+}
+
+int arithmetic_compress_adaptive(const unsigned char* in, size_t size, int update_range,
+                    int range_clear, cf_buffer_t* out)
+{
+    return arithmetic_encode(in, size, ARITH_MODEL_ADAPTIVE, update_range, range_clear, out);
+}
+
+int arithmetic_compress_fenwick(const unsigned char* in, size_t size, int increment, cf_buffer_t* out)
+{
+    return arithmetic_encode(in, size, ARITH_MODEL_FENWICK, increment, 0, out);
+}
+
+int arithmetic_compress_context(const unsigned char* in, size_t size, int order, int increment, cf_buffer_t* out)
+{
+    return arithmetic_encode(in, size, ARITH_MODEL_CONTEXT, increment, order, out);
+}
+
+int arithmetic_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    if (size < ARITH_HEADER_SIZE) {
+        fprintf(stderr, "Error: arithmetic stream is shorter than its header.\n");
+        return -1;
+    }
+    uint64_t input_size = cf_get_u64(in);
+    int model = in[8];
+    int range_clear = in[9];
+    uint32_t update_range = cf_get_u32(in + 10);
+    int symbol_bits = in[14];
+    int precision = in[15];
+    size_t table_size = model == ARITH_MODEL_STATIC ? (size_t) 2 << symbol_bits : 0;
+    if (model > ARITH_MODEL_CONTEXT || update_range < 1 || update_range > INT32_MAX
+            || (model >= ARITH_MODEL_FENWICK && update_range > CF_MAX_MODEL_INCREMENT)
+            || (model == ARITH_MODEL_CONTEXT && (range_clear < 1 || range_clear > AC_MAX_ORDER))
+            || (symbol_bits != 7 && symbol_bits != 8) || precision > AC_MAX_PRECISION
+            || precision < (model >= ARITH_MODEL_FENWICK ? AC_MODEL_MIN_PRECISION : AC_TABLE_BITS)|| size < ARITH_HEADER_SIZE + table_size) {
+        fprintf(stderr, "Error: invalid arithmetic stream header.\n");
+        return -1;
+    }
+    /* No model gives a symbol more than 1 - 2^-AC_TABLE_BITS of the interval,
+     * so every symbol costs over 2^-AC_TABLE_BITS bits: a larger size than this
+     * cannot come from the payload, and is not allocated. */
+    size_t payload_size = size - ARITH_HEADER_SIZE - table_size;
+    uint64_t payload_bits = 8 * (uint64_t) payload_size;
+    if (input_size >= SIZE_MAX || input_size >> AC_TABLE_BITS > payload_bits + AC_MAX_PRECISION) {
+        fprintf(stderr, "Error: arithmetic stream is too short for its size.\n");
+        return -1;
+    }
+
+    ac_state_t decoder_state;
+    init_state(&decoder_state, precision, 1 << symbol_bits);
+    const unsigned char* table = in + ARITH_HEADER_SIZE;
+    for (size_t i = 0; i < table_size / 2; i++) {
+        decoder_state.cumul_table[i] = table[2 * i] | (table[2 * i + 1] << 8);
+    }
+    decoder_state.cumul_table[1 << symbol_bits] = (1 << AC_TABLE_BITS) - 1;
+    // the encoder writes entries at least 2 apart, an empty interval would stall the decoder
+    for (size_t i = 0; i < table_size / 2; i++) {
+        if (decoder_state.cumul_table[i + 1] <= decoder_state.cumul_table[i] || (i == 0 && decoder_state.cumul_table[0] != 0)) {
+            fprintf(stderr, "Error: arithmetic probability table is damaged.\n");
+            free(decoder_state.prob_table);
+            free(decoder_state.cumul_table);
+            return -1;
+        }
+    }
+
+    unsigned char* payload = malloc(payload_size + 1);
+    out->data = malloc((size_t) input_size + 1);
+    out->size = input_size;
+    out->bits = 8 * (uint64_t) input_size;
+    if (payload == NULL || out->data == NULL) {
+        perror("Memory allocation failed");
+        free(payload);
+        free(out->data);
+        out->data = NULL;
+        out->size = 0;
+        out->bits = 0;
+    } else {
+        memcpy(payload, in + ARITH_HEADER_SIZE + table_size, payload_size);
+        int status;
+        if (model == ARITH_MODEL_CONTEXT)
+            status = decode_value_context(out->data, payload, payload_bits, &decoder_state, input_size, range_clear, (int) update_range);
+        else if (model == ARITH_MODEL_FENWICK)
+            status = decode_value_model(out->data, payload, payload_bits, &decoder_state, input_size, (int) update_range);
+        else if (model == ARITH_MODEL_ADAPTIVE)
+            status = decode_value_with_update(out->data, payload, payload_bits, &decoder_state, input_size, (int) update_range, range_clear);
+        else
+            status = decode_value(out->data, payload, payload_bits, &decoder_state, input_size);
+        if (status != 0) {
+            fprintf(stderr, "Error: arithmetic stream is truncated or corrupt.\n");
+            cf_buffer_free(out);
+        }
+    }
+
+    free(payload);
+    free(decoder_state.prob_table);
+    free(decoder_state.cumul_table);
+    return out->data ? 0 : -1;
+}
+
+int rans_compress_ways(const unsigned char* in, size_t size, int ways, cf_buffer_t* out)
+{
+    if (!RANS_VALID_WAYS(ways)) {
+        fprintf(stderr, "Error: rANS supports 1, 4, 8 or 32 ways, not %d.\n", ways);
+        out->data = NULL;
+        out->size = 0;
+        out->bits = 0;
+        return -1;
+    }
+    // same byte counts the Huffman coder builds its table from
+    uint64_t counts[256] = {0};
+    huffman_count(in, size, counts);
+    rans_table_t* table = rans_build_table(counts);
+    if (table == NULL) return -1;
+
+    size_t bound = ways == 1 ? rans_encode_bound(size) : rans_encode_ways_bound(size, ways);
+    out->data = malloc(RANS_HEADER_SIZE + RANS_MAX_TABLE_BYTES + bound);
+    if (out->data == NULL) {
+        perror("Memory allocation failed");
+        out->size = 0;
+        out->bits = 0;
+        rans_free_table(table);
+        return -1;
+    }
+    cf_put_u64(out->data, size);
+    out->data[8] = (unsigned char) ways;
+    size_t header_size = RANS_HEADER_SIZE + rans_write_table(table, out->data + RANS_HEADER_SIZE);
+    unsigned char* payload = out->data + header_size;
+    out->size = header_size + (ways == 1 ? rans_encode(table, in, size, payload)
+                                         : rans_encode_ways(table, in, size, ways, payload));
+    out->bits = 8 * (uint64_t) out->size;
+    rans_free_table(table);
+    return 0;
+}
+
+int rans_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    return rans_compress_ways(in, size, CF_RANS_WAYS, out);
+}
+
+int rans_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    if (size < RANS_HEADER_SIZE) {
+        fprintf(stderr, "Error: rANS stream is shorter than its header.\n");
+        return -1;
+    }
+    uint64_t original_size = cf_get_u64(in);
+    int ways = in[8];
+    if (!RANS_VALID_WAYS(ways)) {
+        fprintf(stderr, "Error: Unsupported rANS way count %d.\n", ways);
+        return -1;
+    }
+    size_t table_size;
+    rans_table_t* table = rans_read_table(in + RANS_HEADER_SIZE, size - RANS_HEADER_SIZE, &table_size);
+    if (table == NULL) return -1;
+    size_t header_size = RANS_HEADER_SIZE + table_size;
+    // a size the payload cannot hold is rejected before it is allocated
+    if (original_size >= SIZE_MAX || original_size > rans_decode_limit(table, size - header_size)) {
+        fprintf(stderr, "Error: rANS stream is too short for its size.\n");
+        rans_free_table(table);
+        return -1;
+    }
+
+    out->data = malloc((size_t) original_size + 1);
+    if (out->data == NULL) {
+        perror("Memory allocation failed");
+        rans_free_table(table);
+        return -1;
+    }
+    const unsigned char* payload = in + header_size;
+    int status = ways == 1 ? rans_decode(table, payload, size - header_size, out->data, original_size)
+                           : rans_decode_ways(table, payload, size - header_size, ways, out->data, original_size);
+    if (status != 0) {
+        cf_buffer_free(out);
+        rans_free_table(table);
+        return -1;
+    }
+    out->size = original_size;
+    out->bits = 8 * (uint64_t) original_size;
+    rans_free_table(table);
+    return 0;
+}
+
+// CF_CODEC_STORE in both directions, the payload is the data
+static int store_copy(const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    out->data = malloc(size + 1);
+    if (out->data == NULL) {
+        perror("Memory allocation failed");
+        out->size = 0;
+        out->bits = 0;
+        return -1;
+    }
+    memcpy(out->data, in, size);
+    out->size = size;
+    out->bits = 8 * (uint64_t) size;
+    return 0;
+}
+
+static const char* const codec_names[CF_CODEC_COUNT] = {
+    NULL, "huffman", "arithmetic", "adaptive", "rans", "context", "store"
+};
+
+const char* cf_codec_name(cf_codec_t codec)
+{
+    return codec > 0 && codec < CF_CODEC_COUNT ? codec_names[codec] : NULL;
+}
+
+cf_codec_t cf_codec_from_name(const char* name)
+{
+    for (int i = 1; i < CF_CODEC_COUNT; ++i) {
+        if (strcmp(name, codec_names[i]) == 0) return (cf_codec_t) i;
+    }
+    return (cf_codec_t) 0;
+}
+
+int cf_compress(cf_codec_t codec, const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    switch (codec) {
+    case CF_CODEC_HUFFMAN:
+        return huffman_compress_buffer(in, size, out);
+    case CF_CODEC_ARITHMETIC:
+        return arithmetic_compress_buffer(in, size, out);
+    case CF_CODEC_ADAPTIVE:
+        return arithmetic_compress_fenwick(in, size, CF_MODEL_INCREMENT, out);
+    case CF_CODEC_CONTEXT:
+        return arithmetic_compress_context(in, size, CF_CONTEXT_ORDER, CF_MODEL_INCREMENT, out);
+    case CF_CODEC_RANS:
+        return rans_compress_buffer(in, size, out);
+    case CF_CODEC_STORE:
+        return store_copy(in, size, out);
+    default:
+        fprintf(stderr, "Error: unknown codec %d.\n", (int) codec);
+        return -1;
+    }
+}
+
+int cf_decompress(cf_codec_t codec, const unsigned char* in, size_t size, cf_buffer_t* out)
+{
+    switch (codec) {
+    case CF_CODEC_HUFFMAN:
+        return huffman_decompress_buffer(in, size, out);
+    case CF_CODEC_ARITHMETIC:
+    case CF_CODEC_ADAPTIVE:
+    case CF_CODEC_CONTEXT:
+        return arithmetic_decompress_buffer(in, size, out);
+    case CF_CODEC_RANS:
+        return rans_decompress_buffer(in, size, out);
+    case CF_CODEC_STORE:
+        return store_copy(in, size, out);
+    default:
+        fprintf(stderr, "Error: unknown codec %d.\n", (int) codec);
+        return -1;
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default Huffman block size, every block is coded independently
+#define CF_BLOCK_SIZE (1 << 20)
+// Default adaptive arithmetic model refresh, in symbols
+#define CF_ADAPTIVE_UPDATE_RANGE 32
+// Default and largest per-symbol increment of the Fenwick model
+#define CF_MODEL_INCREMENT 32
+#define CF_MAX_MODEL_INCREMENT 4096
+// Default order of the context model
+#define CF_CONTEXT_ORDER 2
+// Default number of interleaved rANS states
+#define CF_RANS_WAYS 32
+
+/** Output of the buffer API, data is malloc'd and released with cf_buffer_free */
+typedef struct
+{
+    unsigned char* data;
+    size_t size;
+    uint64_t bits;      // exact length, the last byte of coded output may be padded
+} cf_buffer_t;
+
+/** Codecs of the buffer API */
+typedef enum
+{
+    CF_CODEC_HUFFMAN    = 1,
+    CF_CODEC_ARITHMETIC = 2,
+    CF_CODEC_ADAPTIVE   = 3,    // arithmetic coding with the Fenwick adaptive model
+    CF_CODEC_RANS       = 4,
+    CF_CODEC_CONTEXT    = 5,    // arithmetic coding with an order-1/order-2 context model
+    CF_CODEC_STORE      = 6     // the input as is, for data no codec shrinks
+} cf_codec_t;
+
+// Codec IDs are stored in the container, new codecs only ever get new values
+#define CF_CODEC_COUNT 7
+// Not a codec: cf_container_compress and cf_stream_compress pick one per block
+#define CF_CODEC_AUTO ((cf_codec_t) 0)
+
+void cf_buffer_free(cf_buffer_t* buffer);
+
+/* Little-endian field access for the on-disk formats */
+void cf_put_u32(unsigned char* p, uint32_t value);
+
+uint32_t cf_get_u32(const unsigned char* p);
+
+void cf_put_u64(unsigned char* p, uint64_t value);
+
+uint64_t cf_get_u64(const unsigned char* p);
+
+/* All functions take (pointer, length) input, so embedded '\0' bytes are
+ * kept, and return 0 on success or -1 on failure. */
+int huffman_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+int huffman_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+/* Huffman block mode: block_size chunks share one code table and are coded on
+ * threads workers (<= 0 uses one per core). The block index lets decompression
+ * run in parallel too. The *_buffer functions use the defaults. */
+int huffman_compress_blocks(const unsigned char* in, size_t size, size_t block_size,
+                    int threads, cf_buffer_t* out);
+
+int huffman_decompress_blocks(const unsigned char* in, size_t size, int threads,
+                    cf_buffer_t* out);
+
+int arithmetic_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+/* Single pass adaptive model, no table is stored. The cumulative table is
+ * rebuilt every update_range symbols, range_clear restarts the counts each time.
+ * Both are recorded in the header, arithmetic_decompress_buffer handles either model. */
+int arithmetic_compress_adaptive(const unsigned char* in, size_t size, int update_range,
+                    int range_clear, cf_buffer_t* out);
+
+/* Adaptive model updated after every symbol through a Fenwick tree, increment
+ * (1 .. CF_MAX_MODEL_INCREMENT) is the count added per symbol, larger adapts faster. */
+int arithmetic_compress_fenwick(const unsigned char* in, size_t size, int increment,
+                    cf_buffer_t* out);
+
+/* Adaptive model conditioned on the previous order (1 or 2) bytes, otherwise
+ * like arithmetic_compress_fenwick. Much smaller output on text at the cost of
+ * a 128-512 KiB model. */
+int arithmetic_compress_context(const unsigned char* in, size_t size, int order, int increment,
+                    cf_buffer_t* out);
+
+int arithmetic_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+/* Static rANS: same counts as the Huffman table, far faster than the bitwise
+ * arithmetic coder. Compresses with CF_RANS_WAYS interleaved states. */
+int rans_compress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+/* Static rANS over ways (1, 4, 8 or 32) interleaved states, 1 is the byte-wise
+ * coder. The count is stored, rans_decompress_buffer reads any of them. */
+int rans_compress_ways(const unsigned char* in, size_t size, int ways, cf_buffer_t* out);
+
+int rans_decompress_buffer(const unsigned char* in, size_t size, cf_buffer_t* out);
+
+/* CLI name of a codec ("huffman", "rans", ...), NULL if unknown */
+const char* cf_codec_name(cf_codec_t codec);
+
+// Codec with that CLI name, 0 if there is none
+cf_codec_t cf_codec_from_name(const char* name);
+
+/* Dispatch on codec, same contract as the functions above */
+int cf_compress(cf_codec_t codec, const unsigned char* in, size_t size, cf_buffer_t* out);
+
+int cf_decompress(cf_codec_t codec, const unsigned char* in, size_t size, cf_buffer_t* out);
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "container.h"
+#include "checksum.h"
+#include "codec_select.h"
+#include "parallel.h"
+
+
+void cf_write_container_header(unsigned char* p, const cf_container_header_t* header)
+{
+    memcpy(p, CF_CONTAINER_MAGIC, 4);
+    p[4] = (unsigned char) header->version;
+    p[5] = (unsigned char) header->codec;
+    p[6] = (unsigned char) header->flags;
+    p[7] = (unsigned char) (header->flags >> 8);
+    cf_put_u64(p + 8, header->original_size);
+    cf_put_u64(p + 16, header->payload_bits);
+}
+
+int cf_read_container_header(const unsigned char* p, size_t size, cf_container_header_t* header)
+{
+    if (size < CF_CONTAINER_HEADER_SIZE || memcmp(p, CF_CONTAINER_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: not a compressify container.\n");
+        return -1;
+    }
+    header->version = p[4];
+    header->codec = (cf_codec_t) p[5];
+    header->flags = p[6] | (p[7] << 8);
+    header->original_size = cf_get_u64(p + 8);
+    header->payload_bits = cf_get_u64(p + 16);
+    if (header->version != CF_CONTAINER_VERSION) {
+        fprintf(stderr, "Error: unsupported container version %d.\n", header->version);
+        return -1;
+    }
+    if (header->flags & ~(CF_CONTAINER_INDEXED | CF_CONTAINER_CHECKSUM | CF_CONTAINER_BLOCK_CODEC)) {
+        fprintf(stderr, "Error: unsupported container flags 0x%x.\n", header->flags);
+        return -1;
+    }
+    if (header->flags & CF_CONTAINER_BLOCK_CODEC ? header->codec != CF_CODEC_AUTO
+                                                 : cf_codec_name(header->codec) == NULL) {
+        fprintf(stderr, "Error: unknown codec %d in container.\n", (int) header->codec);
+        return -1;
+    }
+    return 0;
+}
+
+size_t cf_block_record_size(int flags)
+{
+    return CF_BLOCK_RECORD_SIZE + (flags & CF_CONTAINER_CHECKSUM ? CF_BLOCK_CHECKSUM_SIZE : 0)
+         + (flags & CF_CONTAINER_BLOCK_CODEC ? CF_BLOCK_CODEC_SIZE : 0);
+}
+
+void cf_write_block_record(unsigned char* p, int flags, const cf_block_record_t* record)
+{
+    cf_put_u32(p, record->original_size);
+    cf_put_u64(p + 4, record->payload_bits);
+    if (flags & CF_CONTAINER_CHECKSUM) cf_put_u32(p + CF_BLOCK_RECORD_SIZE, record->checksum);
+    if (flags & CF_CONTAINER_BLOCK_CODEC) p[cf_block_record_size(flags) - 1] = (unsigned char) record->codec;
+}
+
+void cf_read_block_record(const unsigned char* p, int flags, cf_block_record_t* record)
+{
+    record->original_size = cf_get_u32(p);
+    record->payload_bits = cf_get_u64(p + 4);
+    record->checksum = flags & CF_CONTAINER_CHECKSUM ? cf_get_u32(p + CF_BLOCK_RECORD_SIZE) : 0;
+    record->codec = flags & CF_CONTAINER_BLOCK_CODEC ? (cf_codec_t) p[cf_block_record_size(flags) - 1]
+                                                     : CF_CODEC_AUTO;
+}
+
+cf_codec_t cf_block_codec(const cf_container_header_t* header, const cf_block_record_t* record)
+{
+    return header->flags & CF_CONTAINER_BLOCK_CODEC ? record->codec : header->codec;
+}
+
+int cf_verify_block(const cf_block_record_t* record, const unsigned char* payload, int flags, int verify)
+{
+    if (!verify || !(flags & CF_CONTAINER_CHECKSUM)) return 0;
+    if (cf_crc32c(0, payload, (size_t) ((record->payload_bits + 7) / 8)) != record->checksum) {
+        fprintf(stderr, "Error: block checksum mismatch, the data is corrupt.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void cf_write_index_entry(unsigned char* p, const cf_index_entry_t* entry)
+{
+    cf_put_u64(p, entry->original_offset);
+    cf_put_u64(p + 8, entry->record_offset);
+    cf_put_u32(p + 16, entry->original_size);
+}
+
+void cf_read_index_entry(const unsigned char* p, cf_index_entry_t* entry)
+{
+    entry->original_offset = cf_get_u64(p);
+    entry->record_offset = cf_get_u64(p + 8);
+    entry->original_size = cf_get_u32(p + 16);
+}
+
+void cf_write_index_trailer(unsigned char* p, uint64_t index_offset, uint32_t block_count)
+{
+    cf_put_u64(p, index_offset);
+    cf_put_u32(p + 8, block_count);
+    memcpy(p + 12, CF_INDEX_MAGIC, 4);
+}
+
+int cf_read_index_trailer(const unsigned char* p, uint64_t* index_offset, uint32_t* block_count)
+{
+    if (memcmp(p + 12, CF_INDEX_MAGIC, 4) != 0) return -1;
+    *index_offset = cf_get_u64(p);
+    *block_count = cf_get_u32(p + 8);
+    return 0;
+}
+
+long cf_index_find(const cf_index_entry_t* entries, uint32_t count, uint64_t offset)
+{
+    // last entry starting at or before offset
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].original_offset <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return -1;
+    const cf_index_entry_t* entry = &entries[lo - 1];
+    return offset - entry->original_offset < entry->original_size ? (long) lo - 1 : -1;
+}
+
+/** Blocks of one cf_container_compress, or one batch of cf_container_decompress */
+typedef struct
+{
+    const unsigned char* in;
+    size_t size;
+    size_t block_size;          // compress: input bytes per block
+    cf_codec_t codec;
+    int flags;
+    int verify;
+    const cf_container_header_t* header;
+    const size_t* offsets;      // decompress: where each block's payload starts in in
+    cf_buffer_t* blocks;
+    cf_block_record_t* records;
+    int* status;
+} container_job_t;
+
+// Select a codec for, compress and checksum block index
+static void compress_block_job(void* arg, size_t index)
+{
+    container_job_t* job = arg;
+    size_t start = index * job->block_size;
+    size_t length = job->size - start < job->block_size ? job->size - start : job->block_size;
+    cf_block_record_t* record = &job->records[index];
+    cf_buffer_t* block = &job->blocks[index];
+    record->original_size = (uint32_t) length;
+    record->codec = job->codec == CF_CODEC_AUTO ? cf_select_codec(job->in + start, length, NULL) : job->codec;
+    job->status[index] = cf_compress(record->codec, job->in + start, length, block);
+    if (job->status[index] == 0) {
+        assert((block->bits + 7) / 8 == block->size && "codec reported a wrong bit length");
+        record->payload_bits = block->bits;
+        if (job->flags & CF_CONTAINER_CHECKSUM) record->checksum = cf_crc32c(0, block->data, block->size);
+    }
+}
+
+// Verify and decompress block index of the batch
+static void decompress_block_job(void* arg, size_t index)
+{
+    container_job_t* job = arg;
+    const cf_block_record_t* record = &job->records[index];
+    const unsigned char* payload = job->in + job->offsets[index];
+    size_t bytes = (size_t) ((record->payload_bits + 7) / 8);
+    job->status[index] = cf_verify_block(record, payload, job->flags, job->verify);
+    if (job->status[index] == 0) {
+        job->status[index] = cf_decompress(cf_block_codec(job->header, record), payload, bytes, &job->blocks[index]);
+    }
+}
+
+int cf_container_compress(cf_codec_t codec, const unsigned char* in, size_t size,
+                    size_t block_size, int flags, cf_buffer_t* out)
+{
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    if (codec != CF_CODEC_AUTO && cf_codec_name(codec) == NULL) {
+        fprintf(stderr, "Error: unknown codec %d.\n", (int) codec);
+        return -1;
+    }
+    if (block_size == 0) block_size = CF_CONTAINER_BLOCK;
+    if (block_size > CF_CONTAINER_MAX_BLOCK) block_size = CF_CONTAINER_MAX_BLOCK;
+    size_t block_count = (size + block_size - 1) / block_size;
+
+    flags = (flags & CF_CONTAINER_CHECKSUM) | CF_CONTAINER_INDEXED;
+    if (codec == CF_CODEC_AUTO) flags |= CF_CONTAINER_BLOCK_CODEC;
+    size_t record_size = cf_block_record_size(flags);
+
+    cf_buffer_t* blocks = calloc(block_count + 1, sizeof(cf_buffer_t));
+    cf_block_record_t* records = calloc(block_count + 1, sizeof(cf_block_record_t));
+    int* status = calloc(block_count + 1, sizeof(int));
+    if (blocks == NULL || records == NULL || status == NULL) {
+        perror("Memory allocation failed");
+        free(blocks);
+        free(records);
+        free(status);
+        return -1;
+    }
+
+    // blocks are independent, each job fills its own slot
+    container_job_t job = {in, size, block_size, codec, flags, 0, NULL, NULL, blocks, records, status};
+    parallel_for(block_count, 0, compress_block_job, &job);
+
+    int result = 0;
+    size_t total = CF_CONTAINER_HEADER_SIZE + record_size * (block_count + 1)
+                 + CF_INDEX_ENTRY_SIZE * block_count + CF_INDEX_TRAILER_SIZE;
+    uint64_t payload_bits = 0;
+    for (size_t i = 0; i < block_count && result == 0; ++i) {
+        result = status[i];
+        total += blocks[i].size;
+        payload_bits += blocks[i].bits;
+    }
+
+    if (result == 0) {
+        out->data = malloc(total);
+        if (out->data == NULL) {
+            perror("Memory allocation failed");
+            result = -1;
+        }
+    }
+    if (result == 0) {
+        cf_container_header_t header = {CF_CONTAINER_VERSION, codec, flags, size, payload_bits};
+        unsigned char* p = out->data;
+        cf_write_container_header(p, &header);
+        p += CF_CONTAINER_HEADER_SIZE;
+        // index entries go after the end record, write them as the blocks are placed
+        unsigned char* index = p + record_size * (block_count + 1);
+        for (size_t i = 0; i < block_count; ++i) index += blocks[i].size;
+        uint64_t index_offset = index - out->data;
+        for (size_t i = 0; i < block_count; ++i) {
+            size_t start = i * block_size;
+            size_t length = size - start < block_size ? size - start : block_size;
+            cf_index_entry_t entry = {start, (uint64_t) (p - out->data), (uint32_t) length};
+            cf_write_index_entry(index + CF_INDEX_ENTRY_SIZE * i, &entry);
+            cf_write_block_record(p, flags, &records[i]);
+            memcpy(p + record_size, blocks[i].data, blocks[i].size);
+            p += record_size + blocks[i].size;
+        }
+        cf_block_record_t end = {0, 0, 0, CF_CODEC_AUTO};
+        cf_write_block_record(p, flags, &end);
+        cf_write_index_trailer(index + CF_INDEX_ENTRY_SIZE * block_count, index_offset, (uint32_t) block_count);
+        out->size = total;
+        out->bits = 8 * (uint64_t) total;
+    }
+
+    for (size_t i = 0; i < block_count; ++i) cf_buffer_free(&blocks[i]);
+    free(blocks);
+    free(records);
+    free(status);
+    return result;
+}
+
+int cf_container_decompress(const unsigned char* in, size_t size, int verify,
+                    cf_container_header_t* header, cf_buffer_t* out)
+{
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    cf_container_header_t parsed;
+    if (cf_read_container_header(in, size, &parsed) != 0) return -1;
+    if (header != NULL) *header = parsed;
+
+    // a known length sizes the output once, otherwise it grows block by block
+    size_t capacity = parsed.original_size != CF_LENGTH_UNKNOWN && parsed.original_size <= SIZE_MAX - 1
+                    ? (size_t) parsed.original_size : 0;
+    if (capacity > size * (size_t) 1024) capacity = 0;  // a lie in the header must not cost memory
+    out->data = malloc(capacity + 1);
+    if (out->data == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+
+    /* Records are read a batch at a time, the batch's blocks are verified and
+     * decoded in parallel and appended in order. A batch holds one block per
+     * core, so memory stays at the output plus one decoded block per core. */
+    size_t batch = (size_t) parallel_default_threads();
+    cf_block_record_t* records = malloc(batch * sizeof(cf_block_record_t));
+    size_t* offsets = malloc(batch * sizeof(size_t));
+    cf_buffer_t* blocks = calloc(batch, sizeof(cf_buffer_t));
+    int* status = malloc(batch * sizeof(int));
+    container_job_t job = {in, size, 0, parsed.codec, parsed.flags, verify, &parsed, offsets, blocks, records, status};
+    size_t record_size = cf_block_record_size(parsed.flags);
+    size_t pos = CF_CONTAINER_HEADER_SIZE;
+    uint64_t payload_bits = 0;
+    int result = -1;
+    int ended = 0;
+    if (records == NULL || offsets == NULL || blocks == NULL || status == NULL) {
+        perror("Memory allocation failed");
+        ended = 1;
+    }
+    while (!ended) {
+        size_t count = 0;
+        int damaged = 0;
+        while (count < batch) {
+            if (size - pos < record_size) {
+                fprintf(stderr, "Error: container ended without its end record.\n");
+                damaged = 1;
+                break;
+            }
+            cf_read_block_record(in + pos, parsed.flags, &records[count]);
+            pos += record_size;
+            if (records[count].original_size == 0) {
+                ended = 1;
+                break;
+            }
+            if (records[count].payload_bits > 8 * (uint64_t) (size - pos)) {
+                fprintf(stderr, "Error: container block is truncated.\n");
+                damaged = 1;
+                break;
+            }
+            offsets[count] = pos;
+            pos += (size_t) ((records[count].payload_bits + 7) / 8);
+            count++;
+        }
+        parallel_for(count, 0, decompress_block_job, &job);
+
+        for (size_t i = 0; i < count && !damaged; ++i) {
+            uint32_t length = records[i].original_size;
+            if (status[i] != 0) {
+                damaged = 1;
+                break;
+            }
+            if (blocks[i].size != length) {
+                fprintf(stderr, "Error: container block decoded to the wrong length.\n");
+                damaged = 1;
+                break;
+            }
+            if (out->size + length > capacity) {
+                capacity = out->size + length > 2 * capacity ? out->size + length : 2 * capacity;
+                unsigned char* grown = realloc(out->data, capacity + 1);
+                if (grown == NULL) {
+                    perror("Memory allocation failed");
+                    damaged = 1;
+                    break;
+                }
+                out->data = grown;
+            }
+            memcpy(out->data + out->size, blocks[i].data, length);
+            out->size += length;
+            payload_bits += records[i].payload_bits;
+        }
+        for (size_t i = 0; i < count; ++i) cf_buffer_free(&blocks[i]);
+        if (damaged) break;
+        if (ended) result = 0;
+    }
+    free(records);
+    free(offsets);
+    free(blocks);
+    free(status);
+
+    if (result == 0 && (parsed.flags & CF_CONTAINER_INDEXED)) {
+        // the index only repeats what the records said, skip it after checking its size
+        uint64_t index_offset;
+        uint32_t block_count;
+        if (size - pos < CF_INDEX_TRAILER_SIZE
+                || cf_read_index_trailer(in + size - CF_INDEX_TRAILER_SIZE, &index_offset, &block_count) != 0
+                || index_offset != pos || size - pos != CF_INDEX_ENTRY_SIZE * (uint64_t) block_count + CF_INDEX_TRAILER_SIZE) {
+            fprintf(stderr, "Error: container index is missing or damaged.\n");
+            result = -1;
+        }
+        pos = size;
+    }
+    if (result == 0 && pos != size) {
+        fprintf(stderr, "Error: unexpected data after the container end record.\n");
+        result = -1;
+    }
+    if (result == 0 && ((parsed.original_size != CF_LENGTH_UNKNOWN && parsed.original_size != out->size)
+            || (parsed.payload_bits != CF_LENGTH_UNKNOWN && parsed.payload_bits != payload_bits))) {
+        fprintf(stderr, "Error: container totals do not match its blocks.\n");
+        result = -1;
+    }
+    if (result != 0) {
+        cf_buffer_free(out);
+        return -1;
+    }
+    out->bits = 8 * (uint64_t) out->size;
+    return 0;
+}
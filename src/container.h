@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compressify.h"
+
+/* Container layout, shared by every codec (little endian):
+ *   "CPFY", u8 version, u8 codec, u16 flags,
+ *   u64 original length, u64 payload length in bits,
+ *   then blocks of (u32 original length, u64 payload bits, (bits + 7) / 8 bytes)
+ *   closed by an all-zero block record.
+ * Every block is one cf_compress() output, so it decodes on its own.
+ * With CF_CONTAINER_CHECKSUM every record, the end record too, also holds the
+ * u32 CRC32C of its payload, checked before the payload reaches the codec.
+ * With CF_CONTAINER_BLOCK_CODEC every record ends in the u8 codec of its block
+ * and the header codec is CF_CODEC_AUTO (0).
+ * With CF_CONTAINER_INDEXED the end record is followed by one index entry per
+ * block (u64 original offset, u64 offset of its record, u32 original length)
+ * and a trailer (u64 offset of the index, u32 block count, "CPFI"), so a reader
+ * can seek from the end of the file straight to the blocks it needs. */
+#define CF_CONTAINER_MAGIC "CPFY"
+#define CF_CONTAINER_VERSION 1
+#define CF_CONTAINER_HEADER_SIZE 24
+#define CF_BLOCK_RECORD_SIZE 12
+#define CF_BLOCK_CHECKSUM_SIZE 4
+#define CF_BLOCK_CODEC_SIZE 1
+#define CF_MAX_BLOCK_RECORD_SIZE (CF_BLOCK_RECORD_SIZE + CF_BLOCK_CHECKSUM_SIZE + CF_BLOCK_CODEC_SIZE)
+#define CF_CONTAINER_INDEXED 0x1
+#define CF_CONTAINER_CHECKSUM 0x2
+#define CF_CONTAINER_BLOCK_CODEC 0x4
+#define CF_INDEX_MAGIC "CPFI"
+#define CF_INDEX_ENTRY_SIZE 20
+#define CF_INDEX_TRAILER_SIZE 16
+// Totals of a container written to a pipe, the block records still hold every length
+#define CF_LENGTH_UNKNOWN UINT64_MAX
+// Default and largest block of cf_container_compress
+#define CF_CONTAINER_BLOCK (8 << 20)
+#define CF_CONTAINER_MAX_BLOCK (1u << 31)
+// No codec codes a block into more bytes than this, a larger record is corrupt
+#define CF_BLOCK_MAX_PAYLOAD(length) (4 * (uint64_t) (length) + 4096)
+
+/** Fixed header fields, enough to validate and route a file without its payload */
+typedef struct
+{
+    int version;
+    cf_codec_t codec;
+    int flags;                  // CF_CONTAINER_INDEXED, CF_CONTAINER_CHECKSUM, CF_CONTAINER_BLOCK_CODEC
+    uint64_t original_size;     // CF_LENGTH_UNKNOWN if not known when written
+    uint64_t payload_bits;      // sum of the block payload bits, same rule
+} cf_container_header_t;
+
+void cf_write_container_header(unsigned char* p, const cf_container_header_t* header);
+
+/* Check magic, version and codec of the first size bytes and fill header.
+ * Returns 0, or -1 (with a message) if this is not a container it can read. */
+int cf_read_container_header(const unsigned char* p, size_t size, cf_container_header_t* header);
+
+/** Record in front of every block, original_size 0 ends the blocks */
+typedef struct
+{
+    uint32_t original_size;
+    uint64_t payload_bits;
+    uint32_t checksum;          // CRC32C of the payload, with CF_CONTAINER_CHECKSUM only
+    cf_codec_t codec;           // with CF_CONTAINER_BLOCK_CODEC only, see cf_block_codec
+} cf_block_record_t;
+
+// Bytes of a block record under the header flags
+size_t cf_block_record_size(int flags);
+
+void cf_write_block_record(unsigned char* p, int flags, const cf_block_record_t* record);
+
+void cf_read_block_record(const unsigned char* p, int flags, cf_block_record_t* record);
+
+// Codec that decodes the block, its own or the header's
+cf_codec_t cf_block_codec(const cf_container_header_t* header, const cf_block_record_t* record);
+
+/* Check payload against the record's checksum when the container has them and
+ * verify is set. Returns 0, or -1 (with a message) on a mismatch. */
+int cf_verify_block(const cf_block_record_t* record, const unsigned char* payload,
+                    int flags, int verify);
+
+/** One block of the trailing index */
+typedef struct
+{
+    uint64_t original_offset;
+    uint64_t record_offset;     // from the start of the container
+    uint32_t original_size;
+} cf_index_entry_t;
+
+void cf_write_index_entry(unsigned char* p, const cf_index_entry_t* entry);
+
+void cf_read_index_entry(const unsigned char* p, cf_index_entry_t* entry);
+
+void cf_write_index_trailer(unsigned char* p, uint64_t index_offset, uint32_t block_count);
+
+// Returns 0, or -1 if p is not an index trailer
+int cf_read_index_trailer(const unsigned char* p, uint64_t* index_offset, uint32_t* block_count);
+
+/* Index entry of the block holding original byte offset, -1 if past the end.
+ * Entries must be sorted, as the writers leave them. */
+long cf_index_find(const cf_index_entry_t* entries, uint32_t count, uint64_t offset);
+
+/* Code in as block_size blocks (0 uses CF_CONTAINER_BLOCK) into one indexed
+ * container, flags may add CF_CONTAINER_CHECKSUM. CF_CODEC_AUTO picks each
+ * block's codec with cf_select_codec. Returns 0 on success or -1 on failure. */
+int cf_container_compress(cf_codec_t codec, const unsigned char* in, size_t size,
+                    size_t block_size, int flags, cf_buffer_t* out);
+
+/* Decode a whole container, the codec comes from its header. verify 0 skips
+ * the block checksums. header may be NULL, otherwise it receives the parsed
+ * header. Returns 0 or -1. */
+int cf_container_decompress(const unsigned char* in, size_t size, int verify,
+                    cf_container_header_t* header, cf_buffer_t* out);
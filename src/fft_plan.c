@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fft_plan.h"
+
+typedef struct
+{
+    int size;
+    fftw_r2r_kind kind;
+    fftw_plan plan;
+} fft_plan_entry_t;
+
+// Guards the cache and every call into FFTW's planner
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+static fft_plan_entry_t plans[CF_FFT_MAX_PLANS];
+static int plan_count;
+static char wisdom_path[4096];
+
+
+fftw_plan cf_fft_plan_r2r(int size, fftw_r2r_kind kind)
+{
+    pthread_mutex_lock(&plan_lock);
+    fftw_plan plan = NULL;
+    for (int i = 0; i < plan_count && plan == NULL; ++i) {
+        if (plans[i].size == size && plans[i].kind == kind) plan = plans[i].plan;
+    }
+    if (plan == NULL && plan_count == CF_FFT_MAX_PLANS) {
+        fprintf(stderr, "Error: more than %d FFT plans requested.\n", CF_FFT_MAX_PLANS);
+    } else if (plan == NULL) {
+        // measuring overwrites the arrays, so plan on scratch ones of the same alignment
+        double* in = fftw_malloc(size * sizeof(double));
+        double* out = fftw_malloc(size * sizeof(double));
+        if (in != NULL && out != NULL) {
+            plan = fftw_plan_r2r_1d(size, in, out, kind, wisdom_path[0] ? FFTW_MEASURE : FFTW_ESTIMATE);
+        }
+        fftw_free(in);
+        fftw_free(out);
+        if (plan == NULL) {
+            fprintf(stderr, "Error: could not plan a %d point transform.\n", size);
+        } else {
+            fft_plan_entry_t entry = {size, kind, plan};
+            plans[plan_count++] = entry;
+            if (wisdom_path[0] && !fftw_export_wisdom_to_filename(wisdom_path)) {
+                fprintf(stderr, "Warning: could not save FFTW wisdom to %s.\n", wisdom_path);
+            }
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+    return plan;
+}
+
+int cf_fft_use_wisdom(const char* path)
+{
+    if (strlen(path) >= sizeof(wisdom_path)) {
+        fprintf(stderr, "Error: FFTW wisdom path is too long.\n");
+        return -1;
+    }
+    pthread_mutex_lock(&plan_lock);
+    strcpy(wisdom_path, path);
+    // a missing file is a first run, the wisdom is written once there is some
+    FILE* file = fopen(path, "r");
+    int result = 0;
+    if (file != NULL) {
+        fclose(file);
+        if (!fftw_import_wisdom_from_filename(path)) {
+            fprintf(stderr, "Error: %s holds no valid FFTW wisdom.\n", path);
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+    return result;
+}
+
+void cf_fft_cleanup(void)
+{
+    pthread_mutex_lock(&plan_lock);
+    for (int i = 0; i < plan_count; ++i) fftw_destroy_plan(plans[i].plan);
+    plan_count = 0;
+    pthread_mutex_unlock(&plan_lock);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <fftw3.h>
+
+// Distinct (size, kind) plans the cache keeps for the life of the process
+#define CF_FFT_MAX_PLANS 16
+
+/* Process-wide plan cache. A plan is made on first use of a (size, kind),
+ * planning is serialized because FFTW's planner is not thread-safe, and the
+ * plan is shared from then on. Run it with fftw_execute_r2r on arrays from
+ * fftw_malloc, which any number of threads may do at once. Returns NULL (with
+ * a message) if FFTW cannot plan it or the cache is full. */
+fftw_plan cf_fft_plan_r2r(int size, fftw_r2r_kind kind);
+
+/* Keep FFTW wisdom in path: import it now and export it after every new plan.
+ * Plans are then made with FFTW_MEASURE instead of FFTW_ESTIMATE, which only
+ * costs time the first time a size is seen. Call before the first plan.
+ * Returns 0, or -1 if path exists but holds no valid wisdom. */
+int cf_fft_use_wisdom(const char* path);
+
+// Destroy every cached plan, cf_fft_plan_r2r starts over afterwards
+void cf_fft_cleanup(void);
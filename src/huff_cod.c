@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "huff_cod.h"
+
+#define MAX_CHAR 256
+// Code lengths are limited so that every code resolves with one table lookup
+#define MAX_CODE_LENGTH 12
+#define LOOKUP_BITS 12
+#if MAX_CODE_LENGTH > LOOKUP_BITS
+#error "codes must fit the lookup table"
+#endif
+
+typedef struct Node {
+    char val;
+    uint64_t freq;
+    struct Node* lchild;
+    struct Node* rchild;
+} Node;
+
+// Storage for every node of one tree, a full tree over 256 symbols has 511 nodes
+typedef struct {
+    Node nodes[2 * MAX_CHAR - 1];
+    int count;
+} NodePool;
+
+// Per-call state of the tree builder, so concurrent builds share nothing.
+// Leaves sorted by frequency and merged nodes form the two queues of the build.
+typedef struct {
+    NodePool pool;
+    Node* leaves[MAX_CHAR];
+    Node* merged[MAX_CHAR];
+    int leaf_count;
+} HuffContext;
+
+// Function to create a new node, NULL once the pool is exhausted (malformed input)
+static Node* createNode(NodePool* pool, char val, uint64_t freq, Node* lchild, Node* rchild) {
+    if (pool->count == 2 * MAX_CHAR - 1) return NULL;
+    Node* node = &pool->nodes[pool->count++];
+    node->val = val;
+    node->freq = freq;
+    node->lchild = lchild;
+    node->rchild = rchild;
+    return node;
+}
+
+// Comparator function for sorting
+static int compare(const void* a, const void* b) {
+    Node* nodeA = *(Node**)a;
+    Node* nodeB = *(Node**)b;
+    return (nodeA->freq > nodeB->freq) - (nodeA->freq < nodeB->freq);
+}
+
+// Canonical Huffman code of one symbol, bits are stored right-aligned in code
+typedef struct {
+    uint64_t code;
+    int length;
+} HuffCode;
+
+// Collect the code length of every leaf with a single walk of the tree
+static void computeCodeLengths(Node* node, int depth, int* lengths) {
+    if (!node) return;
+    if (!node->lchild && !node->rchild) {
+        // Special case: if the tree has only one character, its code is still one bit long
+        lengths[(unsigned char)node->val] = depth > 0 ? depth : 1;
+        return;
+    }
+    computeCodeLengths(node->lchild, depth + 1, lengths);
+    computeCodeLengths(node->rchild, depth + 1, lengths);
+}
+
+// Longest code in the tree, unlike computeCodeLengths it counts leaves that repeat a symbol
+static int treeDepth(const Node* node) {
+    if (!node->lchild && !node->rchild) return 0;
+    int left = treeDepth(node->lchild);
+    int right = treeDepth(node->rchild);
+    return 1 + (left > right ? left : right);
+}
+
+// Take the lighter head of the two queues, leaves win ties
+static Node* takeSmallest(HuffContext* ctx, int* leaf_front, int* merged_front, int merged_count) {
+    if (*leaf_front < ctx->leaf_count &&
+        (*merged_front == merged_count || ctx->leaves[*leaf_front]->freq <= ctx->merged[*merged_front]->freq)) {
+        return ctx->leaves[(*leaf_front)++];
+    }
+    return ctx->merged[(*merged_front)++];
+}
+
+// Two-queue Huffman build: merged nodes come out in non-decreasing order,
+// so after one sort of the leaves every merge is O(1)
+static Node* buildTree(HuffContext* ctx) {
+    qsort(ctx->leaves, ctx->leaf_count, sizeof(Node*), compare);
+
+    int leaf_front = 0, merged_front = 0, merged_count = 0;
+    for (int i = 1; i < ctx->leaf_count; i++) {
+        Node* left = takeSmallest(ctx, &leaf_front, &merged_front, merged_count);
+        Node* right = takeSmallest(ctx, &leaf_front, &merged_front, merged_count);
+        ctx->merged[merged_count++] = createNode(&ctx->pool, -1, left->freq + right->freq, left, right);
+    }
+    return merged_count > 0 ? ctx->merged[merged_count - 1] : ctx->leaves[0];
+}
+
+// One entry of a package-merge list: a leaf, or the package of two
+// neighbouring entries (left, left + 1) of the previous list
+typedef struct {
+    uint64_t weight;
+    int symbol;
+    int left;
+} MergeItem;
+
+static void countMergeItem(const MergeItem* lists, int capacity, int level, int index, int* lengths) {
+    const MergeItem* item = &lists[level * capacity + index];
+    if (item->symbol >= 0) {
+        lengths[item->symbol]++;
+        return;
+    }
+    countMergeItem(lists, capacity, level - 1, item->left, lengths);
+    countMergeItem(lists, capacity, level - 1, item->left + 1, lengths);
+}
+
+// Package-merge: optimal code lengths no longer than max_length for the sorted leaves.
+// Returns -1 if the working lists cannot be allocated.
+static int limitCodeLengths(HuffContext* ctx, int max_length, int* lengths) {
+    int n = ctx->leaf_count;
+    int capacity = 2 * n;
+    int sizes[MAX_CODE_LENGTH];
+    MergeItem* lists = (MergeItem*)malloc(sizeof(MergeItem) * capacity * max_length);
+    if (lists == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+
+    // Deepest level holds the leaves alone
+    for (int i = 0; i < n; i++) {
+        lists[i].weight = ctx->leaves[i]->freq;
+        lists[i].symbol = (unsigned char)ctx->leaves[i]->val;
+        lists[i].left = 0;
+    }
+    sizes[0] = n;
+
+    // Every shallower level merges the leaves with the pairs of the level below
+    for (int level = 1; level < max_length; level++) {
+        const MergeItem* prev = &lists[(level - 1) * capacity];
+        MergeItem* cur = &lists[level * capacity];
+        int packages = sizes[level - 1] / 2;
+        int leaf = 0, package = 0, k = 0;
+        while (leaf < n || package < packages) {
+            uint64_t package_weight = package < packages
+                ? prev[2 * package].weight + prev[2 * package + 1].weight : UINT64_MAX;
+            if (leaf < n && ctx->leaves[leaf]->freq <= package_weight) {
+                cur[k++] = lists[leaf++];
+            } else {
+                cur[k].weight = package_weight;
+                cur[k].symbol = -1;
+                cur[k].left = 2 * package++;
+                k++;
+            }
+        }
+        sizes[level] = k;
+    }
+
+    // Each appearance of a leaf among the 2n - 2 cheapest items adds one bit to its code
+    for (int i = 0; i < MAX_CHAR; i++) lengths[i] = 0;
+    for (int i = 0; i < 2 * n - 2; i++) {
+        countMergeItem(lists, capacity, max_length - 1, i, lengths);
+    }
+    free(lists);
+    return 0;
+}
+
+// Assign canonical codes: shorter codes first, equal lengths ordered by symbol value
+static void buildCanonicalCodes(const int* lengths, HuffCode* table) {
+    int length_count[65] = {0};
+    uint64_t next_code[65] = {0};
+    int max_length = 0;
+
+    for (int i = 0; i < MAX_CHAR; i++) {
+        assert(lengths[i] < 64 && "code length exceeds the bit accumulator");
+        if (lengths[i] > 0) length_count[lengths[i]]++;
+        if (lengths[i] > max_length) max_length = lengths[i];
+    }
+
+    uint64_t code = 0;
+    for (int len = 1; len <= max_length; len++) {
+        code = (code + length_count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+    // length_count[0] counts nothing, so the first length starts from code 0
+    for (int i = 0; i < MAX_CHAR; i++) {
+        table[i].length = lengths[i];
+        table[i].code = lengths[i] > 0 ? next_code[lengths[i]]++ : 0;
+    }
+}
+
+// Rebuild the tree from canonical codes so the serialized tree matches the encoded bits
+static Node* buildCanonicalTree(NodePool* pool, const HuffCode* table) {
+    Node* root = createNode(pool, -1, 0, NULL, NULL);
+    int symbols = 0;
+
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (table[i].length == 0) continue;
+        symbols++;
+        Node* node = root;
+        for (int bit = table[i].length - 1; bit > 0; bit--) {
+            Node** child = ((table[i].code >> bit) & 1) ? &node->rchild : &node->lchild;
+            if (*child == NULL) *child = createNode(pool, -1, 0, NULL, NULL);
+            node = *child;
+        }
+        if (table[i].code & 1) node->rchild = createNode(pool, i, 0, NULL, NULL);
+        else node->lchild = createNode(pool, i, 0, NULL, NULL);
+    }
+
+    // A single symbol only uses the left branch, mirror it so every internal node has two children
+    if (symbols == 1) {
+        root->rchild = createNode(pool, root->lchild->val, 0, NULL, NULL);
+    }
+    return root;
+}
+
+// 64-bit bit accumulator, bits are emitted MSB first one whole word at a time
+typedef struct {
+    uint64_t acc;
+    int count;
+    unsigned char* out;
+    size_t pos;
+} BitWriter;
+
+static void storeWord(BitWriter* writer, uint64_t word) {
+    for (int i = 0; i < 8; i++) {
+        writer->out[writer->pos++] = (unsigned char)(word >> (56 - 8 * i));
+    }
+}
+
+static void putBits(BitWriter* writer, uint64_t code, int length) {
+    if (writer->count + length < 64) {
+        writer->acc = (writer->acc << length) | code;
+        writer->count += length;
+        return;
+    }
+    // Fill the accumulator up to 64 bits, emit it and keep the remaining low bits
+    int room = 64 - writer->count;
+    int rest = length - room;
+    uint64_t word = room == 64 ? code : (writer->acc << room) | (code >> rest);
+    storeWord(writer, word);
+    writer->acc = rest > 0 ? code & ((1ULL << rest) - 1) : 0;
+    writer->count = rest;
+}
+
+// Write the remaining bits left-aligned into whole bytes
+static void flushBits(BitWriter* writer) {
+    while (writer->count > 0) {
+        int shift = writer->count - 8;
+        writer->out[writer->pos++] = (unsigned char)(shift >= 0 ? writer->acc >> shift : writer->acc << -shift);
+        writer->count -= 8;
+    }
+    writer->count = 0;
+    writer->acc = 0;
+}
+
+// Function to serialize the Huffman Tree using pre-order traversal and bit-level storage
+static void serializeTree(Node* root, BitWriter* writer) {
+    if (!root) return;
+
+    if (!root->lchild && !root->rchild) {
+        // Write '1' to indicate a leaf node followed by the 8 bits of the character
+        putBits(writer, 1, 1);
+        putBits(writer, (unsigned char)root->val, 8);
+    } else {
+        // Write '0' to indicate an internal node
+        putBits(writer, 0, 1);
+    }
+
+    serializeTree(root->lchild, writer);
+    serializeTree(root->rchild, writer);
+}
+
+// One entry per LOOKUP_BITS-bit prefix: the symbol it decodes to and its code length
+typedef struct {
+    unsigned char symbol;
+    unsigned char length;
+} LookupEntry;
+
+// Fill every table slot whose index starts with the code of this node
+static void fillLookupTable(Node* node, uint32_t prefix, int depth, LookupEntry* table) {
+    if (!node) return;
+    assert((depth < LOOKUP_BITS || (!node->lchild && !node->rchild)) && "code longer than the lookup table");
+    if (!node->lchild && !node->rchild) {
+        int span = LOOKUP_BITS - depth;
+        uint32_t first = prefix << span;
+        for (uint32_t i = 0; i < (1u << span); i++) {
+            table[first + i].symbol = (unsigned char)node->val;
+            // A tree made of a single leaf still spends one bit per symbol
+            table[first + i].length = depth > 0 ? depth : 1;
+        }
+        return;
+    }
+    fillLookupTable(node->lchild, prefix << 1, depth + 1, table);
+    fillLookupTable(node->rchild, (prefix << 1) | 1, depth + 1, table);
+}
+
+// MSB-first bit reader over a memory buffer, the next bit is always bit 63 of acc
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    int count;
+} BitReader;
+
+// Top up the accumulator to at least 56 valid bits, reading zeros past the end
+static void refillBits(BitReader* reader) {
+    if (reader->pos + 8 <= reader->size) {
+        // Load a whole word; bits beyond the bytes we account for are the same
+        // stream bits the next refill will OR in again
+        uint64_t word = 0;
+        for (int i = 0; i < 8; i++) word = (word << 8) | reader->data[reader->pos + i];
+        reader->acc |= word >> reader->count;
+        int bytes = (63 - reader->count) >> 3;
+        reader->pos += bytes;
+        reader->count += bytes * 8;
+        return;
+    }
+    while (reader->count <= 56) {
+        uint64_t byte = reader->pos < reader->size ? reader->data[reader->pos] : 0;
+        reader->acc |= byte << (56 - reader->count);
+        reader->pos++;
+        reader->count += 8;
+    }
+}
+
+static uint64_t readBits(BitReader* reader, int length) {
+    refillBits(reader);
+    uint64_t value = reader->acc >> (64 - length);
+    reader->acc <<= length;
+    reader->count -= length;
+    return value;
+}
+
+// Number of bits handed out so far, larger than size * 8 once the reader ran past the end
+static uint64_t consumedBits(const BitReader* reader) {
+    return (uint64_t)reader->pos * 8 - reader->count;
+}
+
+// Rebuild the tree written by serializeTree, returns NULL on truncated or malformed input
+static Node* deserializeTree(BitReader* reader, NodePool* pool, int depth) {
+    if (depth >= MAX_CHAR || consumedBits(reader) >= (uint64_t)reader->size * 8) return NULL;
+
+    if (readBits(reader, 1) == 1) {
+        // Leaf node: read the 8 bits of the character
+        char val = (char)readBits(reader, 8);
+        if (consumedBits(reader) > (uint64_t)reader->size * 8) return NULL;
+        return createNode(pool, val, 0, NULL, NULL);
+    }
+
+    // Internal node
+    Node* left = deserializeTree(reader, pool, depth + 1);
+    Node* right = left ? deserializeTree(reader, pool, depth + 1) : NULL;
+    if (!left || !right) return NULL;
+    return createNode(pool, -1, 0, left, right);
+}
+
+struct huffman_table_s {
+    HuffCode codes[MAX_CHAR];
+    int max_length;
+    NodePool pool;
+    Node* root;             // canonical tree, serialized by the encoder
+    LookupEntry* lookup;    // decoder only
+};
+
+void huffman_count(const unsigned char* in, size_t size, uint64_t* counts) {
+    for (size_t i = 0; i < size; i++) {
+        counts[in[i]]++;
+    }
+}
+
+huffman_table_t* huffman_build_table(const uint64_t* counts) {
+    huffman_table_t* table = (huffman_table_t*)calloc(1, sizeof(huffman_table_t));
+    if (table == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+
+    HuffContext ctx;
+    ctx.pool.count = 0;
+    ctx.leaf_count = 0;
+
+    // Create nodes for characters with non-zero frequencies
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (counts[i] > 0) {
+            ctx.leaves[ctx.leaf_count++] = createNode(&ctx.pool, i, counts[i], NULL, NULL);
+        }
+    }
+    if (ctx.leaf_count == 0) return table;
+
+    int lengths[MAX_CHAR] = {0};
+    computeCodeLengths(buildTree(&ctx), 0, lengths);
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (lengths[i] > MAX_CODE_LENGTH) {
+            // Too deep for the decode table, redo the lengths under the limit
+            if (limitCodeLengths(&ctx, MAX_CODE_LENGTH, lengths) != 0) {
+                free(table);
+                return NULL;
+            }
+            break;
+        }
+    }
+
+    // Build the canonical code table once instead of searching the tree for every byte
+    buildCanonicalCodes(lengths, table->codes);
+    table->root = buildCanonicalTree(&table->pool, table->codes);
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (lengths[i] > table->max_length) table->max_length = lengths[i];
+    }
+    return table;
+}
+
+// A block coded with a table built for other data can exceed 8 bits per symbol,
+// bound it by the longest code plus the word putBits may store at the end
+size_t huffman_block_bound(const huffman_table_t* table, size_t size) {
+    return (size * table->max_length + 7) / 8 + sizeof(uint64_t);
+}
+
+uint64_t huffman_coded_bits(const huffman_table_t* table, const uint64_t* counts) {
+    uint64_t bits = 0;
+    for (int i = 0; i < MAX_CHAR; i++) bits += counts[i] * (uint64_t)table->codes[i].length;
+    return bits;
+}
+
+size_t huffman_write_table(const huffman_table_t* table, unsigned char* out) {
+    // Serialize the Huffman tree, padded to a whole byte
+    BitWriter writer = {0, 0, out, 0};
+    serializeTree(table->root, &writer);
+    flushBits(&writer);
+    return writer.pos;
+}
+
+size_t huffman_encode_block(const huffman_table_t* table, const unsigned char* in, size_t size, unsigned char* out) {
+    BitWriter writer = {0, 0, out, 0};
+    for (size_t i = 0; i < size; i++) {
+        const HuffCode* entry = &table->codes[in[i]];
+        putBits(&writer, entry->code, entry->length);
+    }
+    flushBits(&writer);
+    return writer.pos;
+}
+
+huffman_table_t* huffman_read_table(const unsigned char* in, size_t size, size_t* table_size) {
+    huffman_table_t* table = (huffman_table_t*)calloc(1, sizeof(huffman_table_t));
+    LookupEntry* lookup = (LookupEntry*)malloc(sizeof(LookupEntry) << LOOKUP_BITS);
+    if (table == NULL || lookup == NULL) {
+        perror("Memory allocation failed");
+        free(table);
+        free(lookup);
+        return NULL;
+    }
+
+    // Deserialize the Huffman tree, whatever follows starts at the next byte boundary
+    BitReader reader = {in, size, 0, 0, 0};
+    table->root = deserializeTree(&reader, &table->pool, 0);
+    if (table->root == NULL) {
+        fprintf(stderr, "Error: Unexpected end of data while reading the Huffman tree.\n");
+        free(table);
+        free(lookup);
+        return NULL;
+    }
+    *table_size = (consumedBits(&reader) + 7) / 8;
+
+    // A single leaf still costs one bit per symbol
+    int depth = treeDepth(table->root);
+    table->max_length = depth > 0 ? depth : 1;
+    // the encoder limits every code to MAX_CODE_LENGTH, a deeper tree is damaged
+    if (table->max_length > MAX_CODE_LENGTH) {
+        fprintf(stderr, "Error: Huffman tree has a code longer than %d bits.\n", MAX_CODE_LENGTH);
+        free(table);
+        free(lookup);
+        return NULL;
+    }
+
+    table->lookup = lookup;
+    fillLookupTable(table->root, 0, 0, table->lookup);
+    return table;
+}
+
+int huffman_decode_block(const huffman_table_t* table, const unsigned char* in, size_t size, unsigned char* out, size_t out_size) {
+    BitReader reader = {in, size, 0, 0, 0};
+    const LookupEntry* lookup = table->lookup;
+    size_t n = 0;
+
+    // Every code fits the table: a refill leaves at least 56 bits, enough for four codes
+    for (; n + 4 <= out_size; n += 4) {
+        refillBits(&reader);
+        for (int k = 0; k < 4; k++) {
+            const LookupEntry* entry = &lookup[reader.acc >> (64 - LOOKUP_BITS)];
+            out[n + k] = entry->symbol;
+            reader.acc <<= entry->length;
+            reader.count -= entry->length;
+        }
+    }
+
+    for (; n < out_size; n++) {
+        refillBits(&reader);
+        const LookupEntry* entry = &lookup[reader.acc >> (64 - LOOKUP_BITS)];
+        out[n] = entry->symbol;
+        reader.acc <<= entry->length;
+        reader.count -= entry->length;
+    }
+
+    // Past the end the reader only supplies zeros, reject blocks that needed them
+    return consumedBits(&reader) <= (uint64_t)size * 8 ? 0 : -1;
+}
+
+void huffman_free_table(huffman_table_t* table) {
+    if (!table) return;
+    free(table->lookup);
+    free(table);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Serialized tree: at most 255 internal bits plus 256 leaves of 9 bits
+#define HUFFMAN_MAX_TABLE_BYTES ((256 * 9 + 255 + 7) / 8)
+
+/** Canonical Huffman code table, shared by every block of a stream */
+typedef struct huffman_table_s huffman_table_t;
+
+void huffman_count(const unsigned char* in, size_t size, uint64_t* counts);
+
+huffman_table_t* huffman_build_table(const uint64_t* counts);
+
+size_t huffman_block_bound(const huffman_table_t* table, size_t size);
+
+// Exact coded length in bits of input with these byte counts, before byte padding
+uint64_t huffman_coded_bits(const huffman_table_t* table, const uint64_t* counts);
+
+size_t huffman_write_table(const huffman_table_t* table, unsigned char* out);
+
+size_t huffman_encode_block(const huffman_table_t* table, const unsigned char* in,
+                    size_t size, unsigned char* out);
+
+huffman_table_t* huffman_read_table(const unsigned char* in, size_t size, size_t* table_size);
+
+int huffman_decode_block(const huffman_table_t* table, const unsigned char* in,
+                    size_t size, unsigned char* out, size_t out_size);
+
+void huffman_free_table(huffman_table_t* table);
@@ -0,0 +1,435 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lpc_cod.h"
+
+/* Block layout (bits, most significant first):
+ *   fixed: 0, u3 order                     LPC: 1, u4 order - 1, u4 precision - 1,
+ *                                               u5 shift, order s(precision) coefficients
+ *   order warm-up samples of s(bits), u4 partition order p,
+ *   then 2^p partitions of the residuals: u5 Rice parameter k, the residuals.
+ * A residual is zigzag mapped to u and coded as u >> k in unary (zeros, then
+ * a one) and the low k bits. Quotients of RICE_ESCAPE or more are RICE_ESCAPE
+ * zeros, u6 length and u in that many bits instead. */
+#define RICE_ESCAPE 24
+#define RICE_MAX_PARAMETER 30
+#define RICE_MAX_PARTITION_ORDER 8
+// Escaped values are never longer, LPC_MAX_BITS samples leave residuals far below it
+#define RICE_MAX_ESCAPE_BITS 48
+// Partitions are split no smaller than this many residuals
+#define RICE_MIN_PARTITION 32
+#define LPC_MAX_SHIFT 15
+
+
+typedef struct
+{
+    unsigned char* p;
+    uint64_t acc;
+    int count;                  // bits in acc not yet written
+} bit_writer_t;
+
+static void put_bits(bit_writer_t* w, uint64_t value, int n)
+{
+    // n <= 32, so acc never holds more than 39 pending bits
+    w->acc = (w->acc << n) | (value & ((1ull << n) - 1));
+    w->count += n;
+    while (w->count >= 8) {
+        w->count -= 8;
+        *w->p++ = (unsigned char) (w->acc >> w->count);
+    }
+}
+
+static void put_signed(bit_writer_t* w, int64_t value, int n)
+{
+    put_bits(w, (uint64_t) value, n);
+}
+
+static void flush_bits(bit_writer_t* w)
+{
+    if (w->count > 0) *w->p++ = (unsigned char) (w->acc << (8 - w->count));
+    w->count = 0;
+}
+
+typedef struct
+{
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t acc;
+    int count;
+} bit_reader_t;
+
+static int get_bits(bit_reader_t* r, int n, uint64_t* value)
+{
+    while (r->count < n) {
+        if (r->p == r->end) return -1;
+        r->acc = (r->acc << 8) | *r->p++;
+        r->count += 8;
+    }
+    r->count -= n;
+    *value = (r->acc >> r->count) & ((1ull << n) - 1);
+    return 0;
+}
+
+static int get_signed(bit_reader_t* r, int n, int64_t* value)
+{
+    uint64_t bits;
+    if (get_bits(r, n, &bits) != 0) return -1;
+    *value = bits >> (n - 1) ? (int64_t) bits - ((int64_t) 1 << n) : (int64_t) bits;
+    return 0;
+}
+
+// Zeros before the next one, up to RICE_ESCAPE (the escape has no closing one)
+static int get_unary(bit_reader_t* r, uint32_t* zeros)
+{
+    *zeros = 0;
+    for (;;) {
+        if (r->count == 0) {
+            if (r->p == r->end) return -1;
+            r->acc = (r->acc << 8) | *r->p++;
+            r->count = 8;
+        }
+        uint64_t window = r->acc & ((1ull << r->count) - 1);
+        int top = -1;
+        if (window) {
+#if defined(__GNUC__)
+            top = 63 - __builtin_clzll(window);
+#else
+            for (top = r->count - 1; !(window >> top & 1); --top) {}
+#endif
+        }
+        int run = r->count - 1 - top;   // the whole window if it is all zeros
+        if (*zeros + run >= RICE_ESCAPE) {
+            r->count -= RICE_ESCAPE - *zeros;
+            *zeros = RICE_ESCAPE;
+            return 0;
+        }
+        *zeros += run;
+        if (top >= 0) {
+            r->count = top;             // drop the closing one as well
+            return 0;
+        }
+        r->count = 0;
+    }
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return value < 0 ? 2 * (uint64_t) -(value + 1) + 1 : 2 * (uint64_t) value;
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return value & 1 ? -(int64_t) (value >> 1) - 1 : (int64_t) (value >> 1);
+}
+
+// Rice parameter for count values summing to sum, about log2 of the mean
+static int rice_parameter(uint64_t sum, size_t count)
+{
+    int k = 0;
+    while (k < RICE_MAX_PARAMETER && ((uint64_t) count << (k + 1)) < sum) ++k;
+    return k;
+}
+
+static uint64_t rice_cost(uint64_t sum, size_t count)
+{
+    int k = rice_parameter(sum, count);
+    return 5 + count * (uint64_t) (k + 1) + (sum >> k);
+}
+
+static size_t partition_start(size_t count, int order, size_t part)
+{
+    return part * (count >> order);
+}
+
+// Partition order with the smallest estimated cost for these zigzag residuals
+static int best_partition_order(const uint64_t* u, size_t count, uint64_t* cost)
+{
+    int best = 0;
+    *cost = UINT64_MAX;
+    for (int order = 0; order <= RICE_MAX_PARTITION_ORDER; ++order) {
+        if (order > 0 && (count >> order) < RICE_MIN_PARTITION) break;
+        size_t parts = (size_t) 1 << order;
+        uint64_t total = 0;
+        for (size_t part = 0; part < parts; ++part) {
+            size_t start = partition_start(count, order, part);
+            size_t stop = part + 1 == parts ? count : partition_start(count, order, part + 1);
+            uint64_t sum = 0;
+            for (size_t i = start; i < stop; ++i) sum += u[i];
+            total += rice_cost(sum, stop - start);
+        }
+        if (total < *cost) {
+            *cost = total;
+            best = order;
+        }
+    }
+    return best;
+}
+
+static void put_residuals(bit_writer_t* w, const uint64_t* u, size_t count, int order)
+{
+    put_bits(w, (uint64_t) order, 4);
+    size_t parts = (size_t) 1 << order;
+    for (size_t part = 0; part < parts; ++part) {
+        size_t start = partition_start(count, order, part);
+        size_t stop = part + 1 == parts ? count : partition_start(count, order, part + 1);
+        uint64_t sum = 0;
+        for (size_t i = start; i < stop; ++i) sum += u[i];
+        int k = rice_parameter(sum, stop - start);
+        put_bits(w, (uint64_t) k, 5);
+        for (size_t i = start; i < stop; ++i) {
+            uint64_t q = u[i] >> k;
+            if (q >= RICE_ESCAPE) {
+                int length = 0;
+                while (length < 64 && (u[i] >> length)) ++length;
+                put_bits(w, 0, RICE_ESCAPE);
+                put_bits(w, (uint64_t) length, 6);
+                if (length > 32) put_bits(w, u[i] >> 32, length - 32);
+                put_bits(w, u[i], length < 32 ? length : 32);
+                continue;
+            }
+            put_bits(w, 1, (int) q + 1);
+            if (k) put_bits(w, u[i], k);
+        }
+    }
+}
+
+static int get_residuals(bit_reader_t* r, int64_t* residuals, size_t count)
+{
+    uint64_t order;
+    if (get_bits(r, 4, &order) != 0 || order > RICE_MAX_PARTITION_ORDER) return -1;
+    size_t parts = (size_t) 1 << order;
+    if (order > 0 && (count >> order) == 0) return -1;
+    for (size_t part = 0; part < parts; ++part) {
+        size_t start = partition_start(count, (int) order, part);
+        size_t stop = part + 1 == parts ? count : partition_start(count, (int) order, part + 1);
+        uint64_t k;
+        if (get_bits(r, 5, &k) != 0 || k > RICE_MAX_PARAMETER) return -1;
+        for (size_t i = start; i < stop; ++i) {
+            uint32_t q;
+            uint64_t low = 0, high = 0, u;
+            if (get_unary(r, &q) != 0) return -1;
+            if (q == RICE_ESCAPE) {
+                uint64_t length;
+                if (get_bits(r, 6, &length) != 0 || length > RICE_MAX_ESCAPE_BITS) return -1;
+                if (length > 32 && get_bits(r, (int) length - 32, &high) != 0) return -1;
+                if (get_bits(r, length < 32 ? (int) length : 32, &low) != 0) return -1;
+                u = length > 32 ? high << 32 | low : low;
+            } else {
+                if (k && get_bits(r, (int) k, &low) != 0) return -1;
+                u = (uint64_t) q << k | low;
+            }
+            residuals[i] = unzigzag(u);
+        }
+    }
+    return 0;
+}
+
+// Residuals of the fixed polynomial predictor of order, from sample order on
+static int64_t fixed_residual(const int32_t* x, size_t i, int order)
+{
+    switch (order) {
+    case 0: return x[i];
+    case 1: return (int64_t) x[i] - x[i - 1];
+    case 2: return (int64_t) x[i] - 2 * (int64_t) x[i - 1] + x[i - 2];
+    case 3: return (int64_t) x[i] - 3 * (int64_t) x[i - 1] + 3 * (int64_t) x[i - 2] - x[i - 3];
+    default: return (int64_t) x[i] - 4 * (int64_t) x[i - 1] + 6 * (int64_t) x[i - 2] - 4 * (int64_t) x[i - 3] + x[i - 4];
+    }
+}
+
+static int64_t lpc_prediction(const int32_t* x, size_t i, const int32_t* coeffs, int order, int shift)
+{
+    int64_t sum = 0;
+    for (int j = 0; j < order; ++j) sum += (int64_t) coeffs[j] * x[i - 1 - j];
+    return sum >> shift;
+}
+
+/* Quantized LPC coefficients of the best order for x, 0 if the block is too
+ * short or too flat for LPC to be worth its header */
+static int lpc_analyze(const int32_t* x, size_t n, int bits, int32_t* coeffs, int* shift)
+{
+    if (n < 4 * LPC_MAX_ORDER) return 0;
+    double r[LPC_MAX_ORDER + 1] = {0};
+    double* windowed = malloc(n * sizeof(double));
+    if (windowed == NULL) return 0;
+    // Welch window, the autocorrelation then does not see the block edges
+    double half = (n - 1) / 2.0, scale = (n + 1) / 2.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = (i - half) / scale;
+        windowed[i] = x[i] * (1.0 - d * d);
+    }
+    for (int k = 0; k <= LPC_MAX_ORDER; ++k) {
+        for (size_t i = k; i < n; ++i) r[k] += windowed[i] * windowed[i - k];
+    }
+    free(windowed);
+    if (r[0] <= 0.0) return 0;
+
+    // Levinson-Durbin, keeping the coefficients and error of every order
+    double lpc[LPC_MAX_ORDER][LPC_MAX_ORDER];
+    double err[LPC_MAX_ORDER + 1];
+    double a[LPC_MAX_ORDER] = {0};
+    err[0] = r[0];
+    int max_order = 0;
+    for (int m = 0; m < LPC_MAX_ORDER; ++m) {
+        double acc = r[m + 1];
+        for (int j = 0; j < m; ++j) acc -= a[j] * r[m - j];
+        double reflection = acc / err[m];
+        double next[LPC_MAX_ORDER];
+        for (int j = 0; j < m; ++j) next[j] = a[j] - reflection * a[m - 1 - j];
+        next[m] = reflection;
+        memcpy(a, next, (m + 1) * sizeof(double));
+        memcpy(lpc[m], a, (m + 1) * sizeof(double));
+        err[m + 1] = err[m] * (1.0 - reflection * reflection);
+        max_order = m + 1;
+        if (err[m + 1] <= 0.0) break;
+    }
+
+    // each residual costs about half the log2 of the error energy, each coefficient its bits
+    int order = 0;
+    double best = 0.0;
+    for (int m = 1; m <= max_order; ++m) {
+        double per_sample = err[m] > 0.0 ? 0.5 * log2(err[m] / n) : 0.0;
+        double cost = (n - m) * (per_sample > 0.0 ? per_sample : 0.0) + m * (LPC_PRECISION + bits);
+        if (order == 0 || cost < best) {
+            order = m;
+            best = cost;
+        }
+    }
+
+    // largest shift that keeps every coefficient within LPC_PRECISION bits
+    const double* c = lpc[order - 1];
+    double cmax = 0.0;
+    for (int j = 0; j < order; ++j) cmax = fabs(c[j]) > cmax ? fabs(c[j]) : cmax;
+    if (cmax <= 0.0) return 0;
+    int exponent;
+    frexp(cmax, &exponent);
+    *shift = LPC_PRECISION - 1 - exponent;
+    if (*shift > LPC_MAX_SHIFT) *shift = LPC_MAX_SHIFT;
+    if (*shift < 0) return 0;
+    int32_t qmax = (1 << (LPC_PRECISION - 1)) - 1, qmin = -(1 << (LPC_PRECISION - 1));
+    double carry = 0.0;     // the rounding error moves on to the next coefficient
+    for (int j = 0; j < order; ++j) {
+        double value = c[j] * (1 << *shift) + carry;
+        long q = lround(value);
+        q = q > qmax ? qmax : q < qmin ? qmin : q;
+        carry = value - q;
+        coeffs[j] = (int32_t) q;
+    }
+    return order;
+}
+
+size_t lpc_encode_bound(size_t n)
+{
+    // header, warm-up and Rice parameters, then the longest escape per residual
+    return 64 + LPC_MAX_ORDER * 4 + ((size_t) 5 << RICE_MAX_PARTITION_ORDER) / 8
+         + (n * (RICE_ESCAPE + 6 + 64) + 7) / 8;
+}
+
+size_t lpc_encode_block(const int32_t* samples, size_t n, int bits, unsigned char* out)
+{
+    uint64_t* u = malloc((n + 1) * sizeof(uint64_t));
+    if (u == NULL) return 0;
+
+    // the fixed order with the smallest residuals
+    int fixed_order = 0;
+    uint64_t fixed_cost = UINT64_MAX;
+    for (int order = 0; order <= LPC_MAX_FIXED_ORDER && (size_t) order < n; ++order) {
+        uint64_t sum = 0;
+        for (size_t i = order; i < n; ++i) sum += zigzag(fixed_residual(samples, i, order));
+        uint64_t cost = rice_cost(sum, n - order) + order * (uint64_t) bits;
+        if (cost < fixed_cost) {
+            fixed_cost = cost;
+            fixed_order = order;
+        }
+    }
+
+    int32_t coeffs[LPC_MAX_ORDER];
+    int shift = 0;
+    int lpc_order = lpc_analyze(samples, n, bits, coeffs, &shift);
+    int use_lpc = 0;
+    if (lpc_order > 0) {
+        uint64_t sum = 0;
+        for (size_t i = lpc_order; i < n; ++i) sum += zigzag(samples[i] - lpc_prediction(samples, i, coeffs, lpc_order, shift));
+        uint64_t cost = rice_cost(sum, n - lpc_order) + lpc_order * (uint64_t) (bits + LPC_PRECISION) + 13;
+        use_lpc = cost < fixed_cost;
+    }
+
+    bit_writer_t w = {out, 0, 0};
+    int order = use_lpc ? lpc_order : fixed_order;
+    if (use_lpc) {
+        put_bits(&w, 1, 1);
+        put_bits(&w, (uint64_t) (order - 1), 4);
+        put_bits(&w, LPC_PRECISION - 1, 4);
+        put_bits(&w, (uint64_t) shift, 5);
+        for (int j = 0; j < order; ++j) put_signed(&w, coeffs[j], LPC_PRECISION);
+    } else {
+        put_bits(&w, 0, 1);
+        put_bits(&w, (uint64_t) order, 3);
+    }
+    for (int j = 0; j < order; ++j) put_signed(&w, samples[j], bits);
+    for (size_t i = order; i < n; ++i) {
+        int64_t residual = use_lpc ? samples[i] - lpc_prediction(samples, i, coeffs, order, shift)
+                                   : fixed_residual(samples, i, order);
+        u[i - order] = zigzag(residual);
+    }
+    uint64_t cost;
+    int partition_order = best_partition_order(u, n - order, &cost);
+    put_residuals(&w, u, n - order, partition_order);
+    flush_bits(&w);
+    free(u);
+    return (size_t) (w.p - out);
+}
+
+int lpc_decode_block(const unsigned char* in, size_t size, size_t n, int bits,
+                    int32_t* samples, size_t* used)
+{
+    bit_reader_t r = {in, in + size, 0, 0};
+    uint64_t kind, field;
+    int order, shift = 0;
+    int32_t coeffs[LPC_MAX_ORDER];
+    if (get_bits(&r, 1, &kind) != 0) return -1;
+    if (kind) {
+        uint64_t precision, value;
+        if (get_bits(&r, 4, &field) != 0 || get_bits(&r, 4, &precision) != 0 || get_bits(&r, 5, &value) != 0) return -1;
+        order = (int) field + 1;
+        shift = (int) value;
+        if (order > LPC_MAX_ORDER) return -1;
+        for (int j = 0; j < order; ++j) {
+            int64_t coeff;
+            if (get_signed(&r, (int) precision + 1, &coeff) != 0) return -1;
+            coeffs[j] = (int32_t) coeff;
+        }
+    } else {
+        if (get_bits(&r, 3, &field) != 0 || field > LPC_MAX_FIXED_ORDER) return -1;
+        order = (int) field;
+    }
+    if ((size_t) order > n) return -1;
+
+    int64_t low = -((int64_t) 1 << (bits - 1)), high = ((int64_t) 1 << (bits - 1)) - 1;
+    for (int j = 0; j < order; ++j) {
+        int64_t sample;
+        if (get_signed(&r, bits, &sample) != 0) return -1;
+        samples[j] = (int32_t) sample;
+    }
+    int64_t* residuals = malloc((n + 1) * sizeof(int64_t));
+    if (residuals == NULL) return -1;
+    int result = get_residuals(&r, residuals, n - order);
+    for (size_t i = order; i < n && result == 0; ++i) {
+        int64_t residual = residuals[i - order];
+        // fixed_residual(x, i) is x[i] minus the prediction, so the prediction is x[i] - residual with x[i] = 0
+        int64_t prediction;
+        if (kind) {
+            prediction = lpc_prediction(samples, i, coeffs, order, shift);
+        } else {
+            samples[i] = 0;
+            prediction = -fixed_residual(samples, i, order);
+        }
+        int64_t sample = prediction + residual;
+        // a sample out of range means corrupt data, and would overflow the next predictions
+        if (sample < low || sample > high) result = -1;
+        else samples[i] = (int32_t) sample;
+    }
+    free(residuals);
+    *used = (size_t) (r.p - in);
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lossless coding of one channel's block of integer PCM: a fixed polynomial
+ * (order 0 .. 4) or quantized LPC (order 1 .. 12) predictor, whichever codes
+ * smaller, then the residuals as partitioned Rice codes. Every block starts
+ * on a byte boundary and decodes on its own. */
+#define LPC_MAX_ORDER 12
+#define LPC_MAX_FIXED_ORDER 4
+// Bits of a quantized LPC coefficient, sign included
+#define LPC_PRECISION 12
+// Sample sizes the coder takes: up to 24-bit PCM and its one bit wider stereo side
+#define LPC_MIN_BITS 4
+#define LPC_MAX_BITS 25
+
+// Bytes lpc_encode_block may write for n samples
+size_t lpc_encode_bound(size_t n);
+
+/* Code n samples of bits-bit signed PCM into out (lpc_encode_bound(n) bytes).
+ * Returns the bytes written, 0 if it ran out of memory. */
+size_t lpc_encode_block(const int32_t* samples, size_t n, int bits, unsigned char* out);
+
+/* Decode n samples from in. *used receives the bytes the block took.
+ * Returns 0, or -1 if the block is truncated or corrupt. */
+int lpc_decode_block(const unsigned char* in, size_t size, size_t n, int bits,
+                    int32_t* samples, size_t* used);
@@ -0,0 +1,115 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+// Stand-in for an empty file, mmap rejects zero-length mappings
+static const unsigned char empty_file[1];
+
+
+static int read_copy(int fd, cf_mapped_file_t* file)
+{
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    unsigned char* data = malloc(capacity);
+    if (data == NULL)
+    {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    for (;;)
+    {
+        if (size == capacity)
+        {
+            unsigned char* grown = realloc(data, capacity * 2);
+            if (grown == NULL)
+            {
+                perror("Memory allocation failed");
+                free(data);
+                return -1;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n < 0)
+        {
+            perror("Error reading input file");
+            free(data);
+            return -1;
+        }
+        if (n == 0) break;
+        size += (size_t) n;
+    }
+    file->data = data;
+    file->size = size;
+    file->mapped = 0;
+    return 0;
+}
+
+int cf_map_file(const char* path, cf_mapped_file_t* file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Error opening input file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Error reading input file");
+        close(fd);
+        return -1;
+    }
+
+    int result = 0;
+    if (!S_ISREG(st.st_mode))
+    {
+        result = read_copy(fd, file);
+    }
+    else if (st.st_size == 0)
+    {
+        file->data = empty_file;
+    }
+    else
+    {
+        void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            result = read_copy(fd, file);
+        }
+        else
+        {
+            // Codecs make one forward pass: read ahead aggressively, drop pages behind
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            madvise(map, (size_t) st.st_size, MADV_WILLNEED);
+            file->data = map;
+            file->size = (size_t) st.st_size;
+            file->mapped = 1;
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return result;
+}
+
+void cf_unmap_file(cf_mapped_file_t* file)
+{
+    if (file->mapped)
+        munmap((void*) file->data, file->size);
+    else if (file->data != empty_file)
+        free((void*) file->data);
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
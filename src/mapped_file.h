@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+/** Read-only view of a whole input file, mmap'd when possible */
+typedef struct
+{
+    const unsigned char* data;
+    size_t size;
+    int mapped;     // 1 if data is a mapping, 0 if it is a heap copy
+} cf_mapped_file_t;
+
+/* Map path read-only with sequential access hints so the codecs read the page
+ * cache directly. Files that cannot be mapped (pipes, special files) fall back
+ * to a heap copy. data is never NULL on success, even for an empty file.
+ * Returns 0 on success or -1 on failure. */
+int cf_map_file(const char* path, cf_mapped_file_t* file);
+
+void cf_unmap_file(cf_mapped_file_t* file);
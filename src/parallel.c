@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+#define MAX_THREADS 256
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t next;
+    size_t count;
+    parallel_job_t job;
+    void* arg;
+} work_queue_t;
+
+
+int parallel_default_threads(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) return 1;
+    return cores > MAX_THREADS ? MAX_THREADS : (int) cores;
+}
+
+static void* parallel_worker(void* data)
+{
+    work_queue_t* queue = data;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->count) break;
+        queue->job(queue->arg, index);
+    }
+    return NULL;
+}
+
+void parallel_for(size_t count, int threads, parallel_job_t job, void* arg)
+{
+    if (threads <= 0) threads = parallel_default_threads();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if ((size_t) threads > count) threads = (int) count;
+
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) job(arg, i);
+        return;
+    }
+
+    work_queue_t queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.next  = 0;
+    queue.count = count;
+    queue.job   = job;
+    queue.arg   = arg;
+
+    // if a thread cannot be created the remaining workers simply drain more of the queue
+    pthread_t workers[MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; ++i) {
+        if (pthread_create(&workers[started], NULL, parallel_worker, &queue) == 0) started++;
+    }
+    parallel_worker(&queue);
+
+    for (int i = 0; i < started; ++i) pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+/** Job run by parallel_for for every index in [0, count) */
+typedef void (*parallel_job_t)(void* arg, size_t index);
+
+int parallel_default_threads(void);
+
+/* Runs job on a pool of threads workers pulling indices from a shared counter.
+ * The calling thread is one of the workers; threads <= 0 picks parallel_default_threads(). */
+void parallel_for(size_t count, int threads, parallel_job_t job, void* arg);
@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rans_cod.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+// SIMD kernels are compiled per function and picked at run time, no global -m flags
+#define RANS_X86_SIMD 1
+#endif
+
+// The state stays in [RANS_L, RANS_L << 8), whole bytes move in and out
+#define RANS_L (1u << 23)
+// Interleaved states stay in [RANS_WORD_L, 2^32), 16-bit words move in and out
+#define RANS_WORD_L (1u << 16)
+
+
+/* Encoder view of one symbol: the division by freq is replaced by a multiply
+ * with a rounded reciprocal and a shift */
+typedef struct
+{
+    uint32_t x_max;     // renormalize while the state is at or above this
+    uint32_t rcp_freq;
+    uint32_t bias;
+    uint32_t cmpl_freq; // RANS_SCALE - freq
+    uint32_t rcp_shift;
+} rans_enc_symbol_t;
+
+struct rans_table_s
+{
+    uint32_t freq[256];
+    uint32_t cumul[257];
+    rans_enc_symbol_t enc[256];
+    // decode, one load per symbol: symbol | (freq - 1) << 8 | (slot - cumul) << 20
+    uint32_t slots[RANS_SCALE];
+};
+
+
+static void init_enc_symbol(rans_enc_symbol_t* s, uint32_t start, uint32_t freq)
+{
+    s->x_max = ((RANS_L >> RANS_SCALE_BITS) << 8) * freq;
+    s->cmpl_freq = RANS_SCALE - freq;
+    if (freq < 2) {
+        // x / 1 == x: rcp_freq ~0 yields x - 1, the bias puts the 1 back
+        s->rcp_freq = ~0u;
+        s->rcp_shift = 0;
+        s->bias = start + RANS_SCALE - 1;
+    } else {
+        uint32_t shift = 0;
+        while (freq > (1u << shift)) shift++;
+        s->rcp_freq = (uint32_t) (((1ull << (shift + 31)) + freq - 1) / freq);
+        s->rcp_shift = shift - 1;
+        s->bias = start;
+    }
+}
+
+// Fill the cumulative, encode and decode lookups from table->freq
+static void finish_table(rans_table_t* table)
+{
+    table->cumul[0] = 0;
+    for (int i = 0; i < 256; ++i) {
+        table->cumul[i + 1] = table->cumul[i] + table->freq[i];
+        init_enc_symbol(&table->enc[i], table->cumul[i], table->freq[i]);
+        for (uint32_t k = 0; k < table->freq[i]; ++k) {
+            table->slots[table->cumul[i] + k] = (uint32_t) i | (table->freq[i] - 1) << 8 | k << 20;
+        }
+    }
+}
+
+// Largest frequency that can still give up a slot, -1 if none
+static int largest_freq(const uint32_t* freq, uint32_t floor)
+{
+    int best = -1;
+    for (int i = 0; i < 256; ++i) {
+        if (freq[i] > floor && (best < 0 || freq[i] > freq[best])) best = i;
+    }
+    return best;
+}
+
+rans_table_t* rans_build_table(const uint64_t* counts)
+{
+    rans_table_t* table = calloc(1, sizeof(rans_table_t));
+    if (table == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < 256; ++i) total += counts[i];
+
+    if (total == 0) {
+        // nothing to code, any table summing to the scale will do
+        table->freq[0] = RANS_SCALE;
+    } else {
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; ++i) {
+            if (counts[i] == 0) continue;
+            uint64_t f = (uint64_t) ((double) counts[i] * RANS_SCALE / (double) total);
+            table->freq[i] = f > 0 ? (uint32_t) f : 1;
+            sum += table->freq[i];
+        }
+        // rounding leaves the sum off by a few slots, settle them on the largest symbols
+        while (sum < RANS_SCALE) {
+            table->freq[largest_freq(table->freq, 0)]++;
+            sum++;
+        }
+        while (sum > RANS_SCALE) {
+            table->freq[largest_freq(table->freq, 1)]--;
+            sum--;
+        }
+    }
+    finish_table(table);
+    return table;
+}
+
+// Table layout: 32-byte bitmap of the symbols in use, then a u16 frequency for each of them
+size_t rans_write_table(const rans_table_t* table, unsigned char* out)
+{
+    size_t pos = 32;
+    memset(out, 0, 32);
+    for (int i = 0; i < 256; ++i) {
+        if (table->freq[i] == 0) continue;
+        out[i / 8] |= (unsigned char) (1 << (i % 8));
+        out[pos++] = (unsigned char) table->freq[i];
+        out[pos++] = (unsigned char) (table->freq[i] >> 8);
+    }
+    return pos;
+}
+
+rans_table_t* rans_read_table(const unsigned char* in, size_t size, size_t* table_size)
+{
+    size_t pos = 32;
+    if (size < pos) {
+        fprintf(stderr, "Error: Unexpected end of data while reading the rANS table.\n");
+        return NULL;
+    }
+    rans_table_t* table = calloc(1, sizeof(rans_table_t));
+    if (table == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    uint32_t sum = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (!(in[i / 8] & (1 << (i % 8)))) continue;
+        if (pos + 2 > size) {
+            fprintf(stderr, "Error: Unexpected end of data while reading the rANS table.\n");
+            free(table);
+            return NULL;
+        }
+        table->freq[i] = in[pos] | (in[pos + 1] << 8);
+        pos += 2;
+        sum += table->freq[i];
+    }
+    *table_size = pos;
+    if (sum != RANS_SCALE) {
+        fprintf(stderr, "Error: rANS frequencies do not sum to %d.\n", RANS_SCALE);
+        free(table);
+        return NULL;
+    }
+    finish_table(table);
+    return table;
+}
+
+// Every symbol has a frequency of at least 1, so costs at most RANS_SCALE_BITS bits
+size_t rans_encode_bound(size_t size)
+{
+    return (size * RANS_SCALE_BITS + 7) / 8 + 8;
+}
+
+size_t rans_encode(const rans_table_t* table, const unsigned char* in, size_t size, unsigned char* out)
+{
+    // rANS is last in, first out: encode backwards from the end of the buffer
+    unsigned char* end = out + rans_encode_bound(size);
+    unsigned char* ptr = end;
+    uint32_t x = RANS_L;
+
+    for (size_t i = size; i > 0; --i) {
+        const rans_enc_symbol_t* s = &table->enc[in[i - 1]];
+        while (x >= s->x_max) {
+            *--ptr = (unsigned char) x;
+            x >>= 8;
+        }
+        uint32_t q = (uint32_t) (((uint64_t) x * s->rcp_freq) >> 32) >> s->rcp_shift;
+        x += s->bias + q * s->cmpl_freq;
+    }
+
+    // final state, little-endian, read first by the decoder
+    ptr -= 4;
+    ptr[0] = (unsigned char) x;
+    ptr[1] = (unsigned char) (x >> 8);
+    ptr[2] = (unsigned char) (x >> 16);
+    ptr[3] = (unsigned char) (x >> 24);
+
+    size_t coded = (size_t) (end - ptr);
+    memmove(out, ptr, coded);
+    return coded;
+}
+
+uint64_t rans_decode_limit(const rans_table_t* table, size_t size)
+{
+    uint32_t max_freq = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (table->freq[i] > max_freq) max_freq = table->freq[i];
+    }
+    if (max_freq >= RANS_SCALE || size > UINT64_MAX / 8) return UINT64_MAX;
+    // out_size / RANS_SCALE * (RANS_SCALE - max_freq) <= 8 * size, rounded in favour of the stream
+    uint64_t steps = 8 * (uint64_t) size / (RANS_SCALE - max_freq);
+    if (steps >= UINT64_MAX / RANS_SCALE - 1) return UINT64_MAX;
+    return (steps + 1) * RANS_SCALE - 1;
+}
+
+int rans_decode(const rans_table_t* table, const unsigned char* in, size_t size, unsigned char* out, size_t out_size)
+{
+    if (size < 4) {
+        fprintf(stderr, "Error: rANS data is shorter than its state.\n");
+        return -1;
+    }
+    if (out_size > rans_decode_limit(table, size)) {
+        fprintf(stderr, "Error: rANS data is too short for its size.\n");
+        return -1;
+    }
+    const unsigned char* ptr = in + 4;
+    const unsigned char* end = in + size;
+    uint32_t x = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+    if (x < RANS_L) {
+        fprintf(stderr, "Error: invalid rANS state.\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < out_size; ++i) {
+        uint32_t entry = table->slots[x & (RANS_SCALE - 1)];
+        out[i] = (unsigned char) entry;
+        x = (((entry >> 8) & (RANS_SCALE - 1)) + 1) * (x >> RANS_SCALE_BITS) + (entry >> 20);
+        // at most two bytes per symbol, a truncated stream shifts in zeros and fails the check below
+        while (x < RANS_L) x = (x << 8) | (ptr < end ? *ptr++ : 0);
+    }
+
+    // the encoder started from RANS_L, anything else means corrupt data
+    if (x != RANS_L || ptr != end) {
+        fprintf(stderr, "Error: rANS data is corrupt or truncated.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Every symbol costs at most RANS_SCALE_BITS bits, plus the final states
+size_t rans_encode_ways_bound(size_t size, int ways)
+{
+    return (size * RANS_SCALE_BITS + 7) / 8 + 4 * (size_t) ways + 8;
+}
+
+size_t rans_encode_ways(const rans_table_t* table, const unsigned char* in, size_t size, int ways, unsigned char* out)
+{
+    unsigned char* end = out + rans_encode_ways_bound(size, ways);
+    unsigned char* ptr = end;
+    uint32_t x[RANS_MAX_WAYS];
+    for (int k = 0; k < ways; ++k) x[k] = RANS_WORD_L;
+
+    // backwards, so the decoder reads every state's words in symbol order
+    for (size_t i = size; i > 0; --i) {
+        uint32_t* state = &x[(i - 1) % ways];
+        unsigned char s = in[i - 1];
+        uint32_t freq = table->freq[s];
+        if (*state >= (uint64_t) freq << (32 - RANS_SCALE_BITS)) {
+            ptr -= 2;
+            ptr[0] = (unsigned char) *state;
+            ptr[1] = (unsigned char) (*state >> 8);
+            *state >>= 16;
+        }
+        *state = ((*state / freq) << RANS_SCALE_BITS) + (*state % freq) + table->cumul[s];
+    }
+
+    // final states in lane order, little-endian
+    ptr -= 4 * ways;
+    for (int k = 0; k < ways; ++k) {
+        ptr[4 * k]     = (unsigned char) x[k];
+        ptr[4 * k + 1] = (unsigned char) (x[k] >> 8);
+        ptr[4 * k + 2] = (unsigned char) (x[k] >> 16);
+        ptr[4 * k + 3] = (unsigned char) (x[k] >> 24);
+    }
+
+    size_t coded = (size_t) (end - ptr);
+    memmove(out, ptr, coded);
+    return coded;
+}
+
+// Decode symbols [i, out_size), symbol i uses state i % ways. Returns how far it got (always out_size).
+static size_t decode_ways_scalar(const uint32_t* slots, uint32_t* x, int ways, const unsigned char** pptr,
+                    const unsigned char* end, unsigned char* out, size_t i, size_t out_size)
+{
+    const unsigned char* ptr = *pptr;
+    for (; i < out_size; ++i) {
+        uint32_t* state = &x[i % ways];
+        uint32_t entry = slots[*state & (RANS_SCALE - 1)];
+        out[i] = (unsigned char) entry;
+        *state = (((entry >> 8) & (RANS_SCALE - 1)) + 1) * (*state >> RANS_SCALE_BITS) + (entry >> 20);
+        // one word always suffices, a truncated stream reads zeros and fails the final check
+        if (*state < RANS_WORD_L) {
+            uint32_t word = 0;
+            if (ptr + 2 <= end) {
+                word = ptr[0] | (ptr[1] << 8);
+                ptr += 2;
+            }
+            *state = (*state << 16) | word;
+        }
+    }
+    *pptr = ptr;
+    return i;
+}
+
+#ifdef RANS_X86_SIMD
+/* 4 states per __m128i. The renormalization loads the next 4 words and a
+ * byte shuffle picked by the lane mask hands them, in order, to the lanes
+ * that need one. Only whole groups are decoded and only while a full 16-byte
+ * load per vector stays inside the input, the scalar loop finishes the rest. */
+__attribute__((target("sse4.1")))
+static size_t decode_ways_sse41(const uint32_t* slots, uint32_t* x, int ways, const unsigned char** pptr,
+                    const unsigned char* end, unsigned char* out, size_t out_size)
+{
+    unsigned char shuffle[16][16];
+    for (int m = 0; m < 16; ++m) {
+        int rank = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            for (int b = 0; b < 4; ++b) {
+                shuffle[m][4 * lane + b] = (m >> lane) & 1 ? (unsigned char) (4 * rank + b) : 0x80;
+            }
+            if ((m >> lane) & 1) rank++;
+        }
+    }
+
+    const __m128i scale_mask = _mm_set1_epi32(RANS_SCALE - 1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_bytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const unsigned char* ptr = *pptr;
+    size_t i = 0;
+
+    while (out_size - i >= (size_t) ways && end - ptr >= 2 * ways + 16) {
+        for (int v = 0; v < ways; v += 4, i += 4) {
+            __m128i xv = _mm_loadu_si128((const __m128i*) (x + v));
+            __m128i entry = _mm_setr_epi32((int) slots[x[v] & (RANS_SCALE - 1)], (int) slots[x[v + 1] & (RANS_SCALE - 1)],
+                                           (int) slots[x[v + 2] & (RANS_SCALE - 1)], (int) slots[x[v + 3] & (RANS_SCALE - 1)]);
+            __m128i freq = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(entry, 8), scale_mask), one);
+            xv = _mm_add_epi32(_mm_mullo_epi32(freq, _mm_srli_epi32(xv, RANS_SCALE_BITS)), _mm_srli_epi32(entry, 20));
+
+            uint32_t symbols = (uint32_t) _mm_cvtsi128_si32(_mm_shuffle_epi8(entry, low_bytes));
+            memcpy(out + i, &symbols, 4);
+
+            __m128i need = _mm_cmpeq_epi32(_mm_srli_epi32(xv, 16), zero);
+            int m = _mm_movemask_ps(_mm_castsi128_ps(need));
+            __m128i words = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) ptr));
+            words = _mm_shuffle_epi8(words, _mm_loadu_si128((const __m128i*) shuffle[m]));
+            xv = _mm_blendv_epi8(xv, _mm_or_si128(_mm_slli_epi32(xv, 16), words), need);
+            ptr += 2 * __builtin_popcount(m);
+            _mm_storeu_si128((__m128i*) (x + v), xv);
+        }
+    }
+    *pptr = ptr;
+    return i;
+}
+
+// Same as the SSE4.1 kernel with 8 states per __m256i and gathered table lookups
+__attribute__((target("avx2")))
+static size_t decode_ways_avx2(const uint32_t* slots, uint32_t* x, int ways, const unsigned char** pptr,
+                    const unsigned char* end, unsigned char* out, size_t out_size)
+{
+    uint32_t permute[256][8];
+    for (int m = 0; m < 256; ++m) {
+        int rank = 0;
+        for (int lane = 0; lane < 8; ++lane) {
+            permute[m][lane] = (m >> lane) & 1 ? (uint32_t) rank++ : 0;
+        }
+    }
+
+    const __m256i scale_mask = _mm256_set1_epi32(RANS_SCALE - 1);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i low_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                               0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    const unsigned char* ptr = *pptr;
+    size_t i = 0;
+
+    while (out_size - i >= (size_t) ways && end - ptr >= 2 * ways + 16) {
+        for (int v = 0; v < ways; v += 8, i += 8) {
+            __m256i xv = _mm256_loadu_si256((const __m256i*) (x + v));
+            __m256i entry = _mm256_i32gather_epi32((const int*) slots, _mm256_and_si256(xv, scale_mask), 4);
+            __m256i freq = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(entry, 8), scale_mask), one);
+            xv = _mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(xv, RANS_SCALE_BITS)), _mm256_srli_epi32(entry, 20));
+
+            __m256i symbols = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(entry, low_bytes), join);
+            _mm_storel_epi64((__m128i*) (out + i), _mm256_castsi256_si128(symbols));
+
+            __m256i need = _mm256_cmpeq_epi32(_mm256_srli_epi32(xv, 16), zero);
+            int m = _mm256_movemask_ps(_mm256_castsi256_ps(need));
+            __m256i words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) ptr));
+            words = _mm256_permutevar8x32_epi32(words, _mm256_loadu_si256((const __m256i*) permute[m]));
+            xv = _mm256_blendv_epi8(xv, _mm256_or_si256(_mm256_slli_epi32(xv, 16), words), need);
+            ptr += 2 * __builtin_popcount(m);
+            _mm256_storeu_si256((__m256i*) (x + v), xv);
+        }
+    }
+    *pptr = ptr;
+    return i;
+}
+#endif
+
+int rans_decode_ways(const rans_table_t* table, const unsigned char* in, size_t size, int ways, unsigned char* out, size_t out_size)
+{
+    if (!RANS_VALID_WAYS(ways) || size < 4 * (size_t) ways) {
+        fprintf(stderr, "Error: rANS data is shorter than its states.\n");
+        return -1;
+    }
+    // the SIMD kernels and the scalar tail write all out_size bytes whatever the input holds
+    if (out_size > rans_decode_limit(table, size)) {
+        fprintf(stderr, "Error: rANS data is too short for its size.\n");
+        return -1;
+    }
+    uint32_t x[RANS_MAX_WAYS];
+    for (int k = 0; k < ways; ++k) {
+        const unsigned char* p = in + 4 * k;
+        x[k] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+        if (x[k] < RANS_WORD_L) {
+            fprintf(stderr, "Error: invalid rANS state.\n");
+            return -1;
+        }
+    }
+    const unsigned char* ptr = in + 4 * ways;
+    const unsigned char* end = in + size;
+
+    size_t i = 0;
+#ifdef RANS_X86_SIMD
+    if (ways % 8 == 0 && __builtin_cpu_supports("avx2"))
+        i = decode_ways_avx2(table->slots, x, ways, &ptr, end, out, out_size);
+    else if (ways % 4 == 0 && __builtin_cpu_supports("sse4.1"))
+        i = decode_ways_sse41(table->slots, x, ways, &ptr, end, out, out_size);
+#endif
+    decode_ways_scalar(table->slots, x, ways, &ptr, end, out, i, out_size);
+
+    for (int k = 0; k < ways; ++k) {
+        if (x[k] != RANS_WORD_L) ptr = NULL;
+    }
+    if (ptr != end) {
+        fprintf(stderr, "Error: rANS data is corrupt or truncated.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void rans_free_table(rans_table_t* table)
+{
+    free(table);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frequencies are quantized to sum to 2^RANS_SCALE_BITS
+#define RANS_SCALE_BITS 12
+#define RANS_SCALE (1 << RANS_SCALE_BITS)
+// Interleaved format: supported state counts, symbol i goes to state i % ways
+#define RANS_MAX_WAYS 32
+#define RANS_VALID_WAYS(w) ((w) == 1 || (w) == 4 || (w) == 8 || (w) == 32)
+
+// Largest serialized table: symbol bitmap plus one u16 frequency per byte value
+#define RANS_MAX_TABLE_BYTES (32 + 256 * 2)
+
+/** Static rANS model: quantized frequencies plus the encode and decode lookups */
+typedef struct rans_table_s rans_table_t;
+
+/* Quantize byte counts (as from huffman_count) into a table, every byte that
+ * occurs keeps a frequency of at least 1 */
+rans_table_t* rans_build_table(const uint64_t* counts);
+
+size_t rans_write_table(const rans_table_t* table, unsigned char* out);
+
+rans_table_t* rans_read_table(const unsigned char* in, size_t size, size_t* table_size);
+
+size_t rans_encode_bound(size_t size);
+
+/* Byte-wise rANS with a 32-bit state. Returns the coded size, out needs
+ * rans_encode_bound(size) bytes. */
+size_t rans_encode(const rans_table_t* table, const unsigned char* in, size_t size,
+                    unsigned char* out);
+
+/* Most symbols a payload of size bytes can decode to with table, in either
+ * format: a symbol of frequency f moves the state down by over (RANS_SCALE - f)
+ * / RANS_SCALE bits, and every bit it loses came from the payload. UINT64_MAX
+ * if one symbol has the whole scale, it costs nothing. */
+uint64_t rans_decode_limit(const rans_table_t* table, size_t size);
+
+// Returns 0 on success, -1 if the data is truncated or corrupt or out_size is above rans_decode_limit
+int rans_decode(const rans_table_t* table, const unsigned char* in, size_t size,
+                    unsigned char* out, size_t out_size);
+
+/* Interleaved rANS over ways (4, 8 or 32) 32-bit states with 16-bit
+ * renormalization, so independent states keep the decoder out of one long
+ * dependency chain. Decoding runs the states in AVX2 or SSE4.1 lanes when
+ * the CPU has them (checked at run time) and in scalar code otherwise, the
+ * output is the same. ways 1 is the byte-wise coder above. */
+size_t rans_encode_ways_bound(size_t size, int ways);
+
+size_t rans_encode_ways(const rans_table_t* table, const unsigned char* in, size_t size,
+                    int ways, unsigned char* out);
+
+int rans_decode_ways(const rans_table_t* table, const unsigned char* in, size_t size,
+                    int ways, unsigned char* out, size_t out_size);
+
+void rans_free_table(rans_table_t* table);
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stream.h"
+#include "container.h"
+#include "checksum.h"
+#include "codec_select.h"
+
+
+// read up to size bytes, short only at end of input
+static size_t read_full(FILE* in, unsigned char* data, size_t size)
+{
+    size_t total = 0;
+    while (total < size) {
+        size_t n = fread(data + total, 1, size - total, in);
+        if (n == 0) break;
+        total += n;
+    }
+    return total;
+}
+
+static int write_frame(FILE* out, int flags, cf_codec_t codec, size_t original_size, const cf_buffer_t* frame)
+{
+    unsigned char record[CF_MAX_BLOCK_RECORD_SIZE];
+    size_t record_size = cf_block_record_size(flags);
+    cf_block_record_t fields = {(uint32_t) original_size, frame->bits, 0, codec};
+    if (flags & CF_CONTAINER_CHECKSUM) fields.checksum = cf_crc32c(0, frame->data, frame->size);
+    cf_write_block_record(record, flags, &fields);
+    if (fwrite(record, 1, record_size, out) != record_size) return -1;
+    if (fwrite(frame->data, 1, frame->size, out) != frame->size) return -1;
+    return 0;
+}
+
+// Index entries and trailer after the end record, index_offset is where they start
+static int write_index(FILE* out, const cf_index_entry_t* entries, uint32_t count, uint64_t index_offset)
+{
+    unsigned char bytes[CF_INDEX_ENTRY_SIZE > CF_INDEX_TRAILER_SIZE ? CF_INDEX_ENTRY_SIZE : CF_INDEX_TRAILER_SIZE];
+    for (uint32_t i = 0; i < count; ++i) {
+        cf_write_index_entry(bytes, &entries[i]);
+        if (fwrite(bytes, 1, CF_INDEX_ENTRY_SIZE, out) != CF_INDEX_ENTRY_SIZE) return -1;
+    }
+    cf_write_index_trailer(bytes, index_offset, count);
+    return fwrite(bytes, 1, CF_INDEX_TRAILER_SIZE, out) == CF_INDEX_TRAILER_SIZE ? 0 : -1;
+}
+
+static int write_header(FILE* out, cf_codec_t codec, int flags, uint64_t original_size, uint64_t payload_bits)
+{
+    unsigned char header[CF_CONTAINER_HEADER_SIZE];
+    cf_container_header_t fields = {CF_CONTAINER_VERSION, codec, flags, original_size, payload_bits};
+    cf_write_container_header(header, &fields);
+    return fwrite(header, 1, CF_CONTAINER_HEADER_SIZE, out) == CF_CONTAINER_HEADER_SIZE ? 0 : -1;
+}
+
+struct cf_stream_writer_s
+{
+    FILE* out;
+    cf_codec_t codec;
+    int flags;
+    long start;                 // header position, -1 if out cannot seek
+    int status;
+    uint64_t original_size;
+    uint64_t payload_bits;
+    // offsets are counted, not asked of out, so the index is right on pipes too
+    uint64_t written;
+    cf_index_entry_t* entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+};
+
+cf_stream_writer_t* cf_stream_writer_open(FILE* out, cf_codec_t codec, int flags)
+{
+    if (codec != CF_CODEC_AUTO && cf_codec_name(codec) == NULL) {
+        fprintf(stderr, "Error: unknown codec %d.\n", (int) codec);
+        return NULL;
+    }
+    cf_stream_writer_t* writer = calloc(1, sizeof(cf_stream_writer_t));
+    if (writer == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    writer->out = out;
+    writer->codec = codec;
+    writer->flags = (flags & CF_CONTAINER_CHECKSUM) | CF_CONTAINER_INDEXED;
+    if (codec == CF_CODEC_AUTO) writer->flags |= CF_CONTAINER_BLOCK_CODEC;
+    writer->written = CF_CONTAINER_HEADER_SIZE;
+
+    // totals are only known at the end, a seekable output gets them patched in
+    writer->start = ftell(out);
+    if (write_header(out, codec, writer->flags, CF_LENGTH_UNKNOWN, CF_LENGTH_UNKNOWN) != 0) {
+        perror("Error writing output");
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int cf_stream_write_block(cf_stream_writer_t* writer, const unsigned char* data, size_t size)
+{
+    if (writer->status != 0) return -1;
+    if (size == 0) return 0;    // a zero length record would end the container
+    if (size > CF_CONTAINER_MAX_BLOCK) {
+        fprintf(stderr, "Error: stream block of %zu bytes is too large.\n", size);
+        writer->status = -1;
+        return -1;
+    }
+    if (writer->entry_count == writer->entry_capacity) {
+        uint32_t capacity = writer->entry_capacity ? 2 * writer->entry_capacity : 64;
+        cf_index_entry_t* grown = realloc(writer->entries, capacity * sizeof(cf_index_entry_t));
+        if (grown == NULL) {
+            perror("Memory allocation failed");
+            writer->status = -1;
+            return -1;
+        }
+        writer->entries = grown;
+        writer->entry_capacity = capacity;
+    }
+    cf_buffer_t frame;
+    cf_codec_t codec = writer->codec == CF_CODEC_AUTO ? cf_select_codec(data, size, NULL) : writer->codec;
+    if (cf_compress(codec, data, size, &frame) != 0) {
+        writer->status = -1;
+        return -1;
+    }
+    if (write_frame(writer->out, writer->flags, codec, size, &frame) != 0) {
+        perror("Error writing output");
+        writer->status = -1;
+    }
+    cf_index_entry_t entry = {writer->original_size, writer->written, (uint32_t) size};
+    writer->entries[writer->entry_count++] = entry;
+    writer->written += cf_block_record_size(writer->flags) + frame.size;
+    writer->original_size += size;
+    writer->payload_bits += frame.bits;
+    cf_buffer_free(&frame);
+    return writer->status;
+}
+
+int cf_stream_writer_close(cf_stream_writer_t* writer)
+{
+    FILE* out = writer->out;
+    int result = writer->status;
+    size_t record_size = cf_block_record_size(writer->flags);
+
+    // an all-zero record closes the stream
+    unsigned char end[CF_MAX_BLOCK_RECORD_SIZE] = {0};
+    if (result == 0 && fwrite(end, 1, record_size, out) != record_size) result = -1;
+    if (result == 0 && write_index(out, writer->entries, writer->entry_count, writer->written + record_size) != 0) result = -1;
+    if (result == 0 && writer->start >= 0 && fseek(out, writer->start, SEEK_SET) == 0) {
+        if (write_header(out, writer->codec, writer->flags, writer->original_size, writer->payload_bits) != 0
+                || fseek(out, 0, SEEK_END) != 0) result = -1;
+    }
+    if (result == 0 && fflush(out) != 0) result = -1;
+    if (result != 0 && writer->status == 0) perror("Error writing output");
+
+    free(writer->entries);
+    free(writer);
+    return result;
+}
+
+int cf_stream_compress(FILE* in, FILE* out, cf_codec_t codec, size_t window, int flags)
+{
+    if (window == 0) window = CF_STREAM_WINDOW;
+    if (window > CF_STREAM_MAX_WINDOW) window = CF_STREAM_MAX_WINDOW;
+
+    unsigned char* chunk = malloc(window);
+    if (chunk == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    cf_stream_writer_t* writer = cf_stream_writer_open(out, codec, flags);
+    if (writer == NULL) {
+        free(chunk);
+        return -1;
+    }
+    int result = 0;
+    size_t n;
+    while (result == 0 && (n = read_full(in, chunk, window)) > 0) {
+        result = cf_stream_write_block(writer, chunk, n);
+    }
+    if (result == 0 && ferror(in)) {
+        perror("Error reading input");
+        result = -1;
+    }
+    if (cf_stream_writer_close(writer) != 0) result = -1;
+
+    free(chunk);
+    return result;
+}
+
+struct cf_stream_reader_s
+{
+    FILE* in;
+    cf_container_header_t header;
+    int verify;
+    unsigned char* frame;
+    size_t capacity;
+    uint64_t original_size;
+    uint64_t payload_bits;
+};
+
+cf_stream_reader_t* cf_stream_reader_open(FILE* in, cf_codec_t codec, int verify)
+{
+    unsigned char header[CF_CONTAINER_HEADER_SIZE];
+    cf_container_header_t fields;
+    if (read_full(in, header, CF_CONTAINER_HEADER_SIZE) != CF_CONTAINER_HEADER_SIZE
+            || cf_read_container_header(header, CF_CONTAINER_HEADER_SIZE, &fields) != 0) {
+        fprintf(stderr, "Error: input does not start with a container header.\n");
+        return NULL;
+    }
+    if (codec != 0 && codec != fields.codec) {
+        fprintf(stderr, "Error: stream was written with %s, not %s.\n",
+                cf_codec_name(fields.codec) ? cf_codec_name(fields.codec) : "auto",
+                cf_codec_name(codec) ? cf_codec_name(codec) : "?");
+        return NULL;
+    }
+    cf_stream_reader_t* reader = calloc(1, sizeof(cf_stream_reader_t));
+    if (reader == NULL) {
+        perror("Memory allocation failed");
+        return NULL;
+    }
+    reader->in = in;
+    reader->header = fields;
+    reader->verify = verify;
+    return reader;
+}
+
+int cf_stream_read_block(cf_stream_reader_t* reader, cf_buffer_t* out)
+{
+    const cf_container_header_t* fields = &reader->header;
+    size_t record_size = cf_block_record_size(fields->flags);
+    unsigned char bytes[CF_MAX_BLOCK_RECORD_SIZE];
+    out->data = NULL;
+    out->size = 0;
+    out->bits = 0;
+    if (read_full(reader->in, bytes, record_size) != record_size) {
+        fprintf(stderr, "Error: stream ended without its end marker.\n");
+        return -1;
+    }
+    cf_block_record_t record;
+    cf_read_block_record(bytes, fields->flags, &record);
+    uint32_t length = record.original_size;
+    uint64_t bits = record.payload_bits;
+    if (length == 0) {
+        if ((fields->original_size != CF_LENGTH_UNKNOWN && fields->original_size != reader->original_size)
+                || (fields->payload_bits != CF_LENGTH_UNKNOWN && fields->payload_bits != reader->payload_bits)) {
+            fprintf(stderr, "Error: stream totals do not match its frames.\n");
+            return -1;
+        }
+        return 0;
+    }
+    // a corrupt length must not turn into a huge allocation
+    if (bits / 8 > CF_BLOCK_MAX_PAYLOAD(length)) {
+        fprintf(stderr, "Error: invalid stream frame length.\n");
+        return -1;
+    }
+    size_t size = (size_t) ((bits + 7) / 8);
+
+    // frames only grow up to the largest one seen, so memory stays bounded by the window
+    if (size > reader->capacity) {
+        unsigned char* grown = realloc(reader->frame, size);
+        if (grown == NULL) {
+            perror("Memory allocation failed");
+            return -1;
+        }
+        reader->frame = grown;
+        reader->capacity = size;
+    }
+    if (read_full(reader->in, reader->frame, size) != size) {
+        fprintf(stderr, "Error: stream frame is truncated.\n");
+        return -1;
+    }
+    if (cf_verify_block(&record, reader->frame, fields->flags, reader->verify) != 0) return -1;
+
+    if (cf_decompress(cf_block_codec(fields, &record), reader->frame, size, out) != 0) return -1;
+    if (out->size != length) {
+        fprintf(stderr, "Error: stream frame decoded to the wrong length.\n");
+        cf_buffer_free(out);
+        return -1;
+    }
+    reader->original_size += length;
+    reader->payload_bits += bits;
+    return 1;
+}
+
+void cf_stream_reader_close(cf_stream_reader_t* reader)
+{
+    free(reader->frame);
+    free(reader);
+}
+
+int cf_stream_decompress(FILE* in, FILE* out, cf_codec_t codec, int verify)
+{
+    cf_stream_reader_t* reader = cf_stream_reader_open(in, codec, verify);
+    if (reader == NULL) return -1;
+    int result;
+    cf_buffer_t decoded;
+    while ((result = cf_stream_read_block(reader, &decoded)) > 0) {
+        int failed = fwrite(decoded.data, 1, decoded.size, out) != decoded.size;
+        cf_buffer_free(&decoded);
+        if (failed) {
+            perror("Error writing output");
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0 && fflush(out) != 0) result = -1;
+
+    cf_stream_reader_close(reader);
+    return result;
+}
+
+int cf_stream_read_range(FILE* in, FILE* out, uint64_t offset, uint64_t length, int verify)
+{
+    unsigned char header[CF_CONTAINER_HEADER_SIZE];
+    unsigned char trailer[CF_INDEX_TRAILER_SIZE];
+    cf_container_header_t fields;
+    uint64_t index_offset;
+    uint32_t count;
+    if (fseek(in, 0, SEEK_SET) != 0 || read_full(in, header, CF_CONTAINER_HEADER_SIZE) != CF_CONTAINER_HEADER_SIZE
+            || cf_read_container_header(header, CF_CONTAINER_HEADER_SIZE, &fields) != 0) {
+        fprintf(stderr, "Error: range reads need a seekable container file.\n");
+        return -1;
+    }
+    if (!(fields.flags & CF_CONTAINER_INDEXED) || fseek(in, -CF_INDEX_TRAILER_SIZE, SEEK_END) != 0
+            || read_full(in, trailer, CF_INDEX_TRAILER_SIZE) != CF_INDEX_TRAILER_SIZE
+            || cf_read_index_trailer(trailer, &index_offset, &count) != 0) {
+        fprintf(stderr, "Error: container has no block index.\n");
+        return -1;
+    }
+    long end = ftell(in);
+    if (end < 0 || index_offset > (uint64_t) end
+            || ((uint64_t) end - index_offset - CF_INDEX_TRAILER_SIZE) / CF_INDEX_ENTRY_SIZE != count) {
+        fprintf(stderr, "Error: container index is damaged.\n");
+        return -1;
+    }
+
+    // only the index and the blocks overlapping the range are read
+    cf_index_entry_t* entries = malloc((count + 1) * sizeof(cf_index_entry_t));
+    unsigned char* bytes = malloc((size_t) count * CF_INDEX_ENTRY_SIZE + 1);
+    int result = -1;
+    if (entries == NULL || bytes == NULL) {
+        perror("Memory allocation failed");
+        goto done;
+    }
+    if (fseek(in, (long) index_offset, SEEK_SET) != 0
+            || read_full(in, bytes, (size_t) count * CF_INDEX_ENTRY_SIZE) != (size_t) count * CF_INDEX_ENTRY_SIZE) {
+        fprintf(stderr, "Error: container index is truncated.\n");
+        goto done;
+    }
+    for (uint32_t i = 0; i < count; ++i) cf_read_index_entry(bytes + (size_t) i * CF_INDEX_ENTRY_SIZE, &entries[i]);
+    free(bytes);
+    bytes = NULL;
+
+    // no checksum covers the index: the blocks must tile the input in file order
+    uint64_t covered = 0;
+    uint64_t record_floor = CF_CONTAINER_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (entries[i].original_offset != covered || entries[i].original_size == 0
+                || entries[i].record_offset < record_floor || entries[i].record_offset >= index_offset) {
+            fprintf(stderr, "Error: container index is damaged.\n");
+            goto done;
+        }
+        covered += entries[i].original_size;
+        record_floor = entries[i].record_offset + 1;
+    }
+    if (fields.original_size != CF_LENGTH_UNKNOWN && covered != fields.original_size) {
+        fprintf(stderr, "Error: container index is damaged.\n");
+        goto done;
+    }
+
+    uint64_t stop = length > UINT64_MAX - offset ? UINT64_MAX : offset + length;
+    long first = length > 0 ? cf_index_find(entries, count, offset) : -1;
+    result = 0;
+    for (uint32_t i = first < 0 ? count : (uint32_t) first; i < count && entries[i].original_offset < stop; ++i) {
+        unsigned char record_bytes[CF_MAX_BLOCK_RECORD_SIZE];
+        size_t record_size = cf_block_record_size(fields.flags);
+        cf_block_record_t record;
+        result = -1;
+        if (fseek(in, (long) entries[i].record_offset, SEEK_SET) != 0
+                || read_full(in, record_bytes, record_size) != record_size) break;
+        cf_read_block_record(record_bytes, fields.flags, &record);
+        uint32_t block_size = record.original_size;
+        uint64_t bits = record.payload_bits;
+        if (block_size != entries[i].original_size || bits / 8 > CF_BLOCK_MAX_PAYLOAD(block_size)) {
+            fprintf(stderr, "Error: block %u does not match the index.\n", i);
+            break;
+        }
+        size_t size = (size_t) ((bits + 7) / 8);
+        bytes = malloc(size + 1);
+        if (bytes == NULL) {
+            perror("Memory allocation failed");
+            break;
+        }
+        if (read_full(in, bytes, size) != size) {
+            fprintf(stderr, "Error: block %u is truncated.\n", i);
+            break;
+        }
+        if (cf_verify_block(&record, bytes, fields.flags, verify) != 0) break;
+        cf_buffer_t decoded;
+        if (cf_decompress(cf_block_codec(&fields, &record), bytes, size, &decoded) != 0) break;
+        free(bytes);
+        bytes = NULL;
+        if (decoded.size != block_size) {
+            fprintf(stderr, "Error: block %u decoded to the wrong length.\n", i);
+            cf_buffer_free(&decoded);
+            break;
+        }
+
+        // the part of the block inside [offset, stop)
+        uint64_t from = offset > entries[i].original_offset ? offset - entries[i].original_offset : 0;
+        uint64_t to = stop - entries[i].original_offset < block_size ? stop - entries[i].original_offset : block_size;
+        if (from > to) from = to;
+        int failed = fwrite(decoded.data + from, 1, (size_t) (to - from), out) != to - from;
+        cf_buffer_free(&decoded);
+        if (failed) {
+            perror("Error writing output");
+            break;
+        }
+        result = 0;
+    }
+    if (result == 0 && fflush(out) != 0) result = -1;
+
+done:
+    free(bytes);
+    free(entries);
+    return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "compressify.h"
+
+// Default stream window: input is read, coded and written this many bytes at a time
+#define CF_STREAM_WINDOW (8 << 20)
+#define CF_STREAM_MAX_WINDOW (256 << 20)
+
+/* Streams are containers (container.h) with one block per window, each coded
+ * on its own with the buffer API. Memory use is bounded by the window, so FILE*
+ * may be pipes such as stdin/stdout. The header totals are filled in when out
+ * can seek back, a pipe gets CF_LENGTH_UNKNOWN. flags may add
+ * CF_CONTAINER_CHECKSUM, CF_CODEC_AUTO picks the codec of every window with
+ * cf_select_codec. Decompression takes the codec from the header, a
+ * non-zero codec must match it, and checks block checksums unless verify is 0.
+ * Both return 0 on success or -1 on failure; window 0 uses CF_STREAM_WINDOW. */
+int cf_stream_compress(FILE* in, FILE* out, cf_codec_t codec, size_t window, int flags);
+
+int cf_stream_decompress(FILE* in, FILE* out, cf_codec_t codec, int verify);
+
+/** Container written one block at a time, for callers that build the blocks */
+typedef struct cf_stream_writer_s cf_stream_writer_t;
+
+/* Start a container at the current position of out, codec and flags as for
+ * cf_stream_compress. Returns NULL (with a message) on failure. */
+cf_stream_writer_t* cf_stream_writer_open(FILE* out, cf_codec_t codec, int flags);
+
+// Code size bytes as the next block, empty blocks are skipped. Returns 0 or -1.
+int cf_stream_write_block(cf_stream_writer_t* writer, const unsigned char* data, size_t size);
+
+/* Write the end record and index and patch the header totals when out can seek
+ * back. Frees writer; returns 0, or -1 if this or an earlier write failed. */
+int cf_stream_writer_close(cf_stream_writer_t* writer);
+
+/** Container read back one block at a time, only the current block is held */
+typedef struct cf_stream_reader_s cf_stream_reader_t;
+
+/* Read the container header at the current position of in, codec and verify
+ * as for cf_stream_decompress. Returns NULL (with a message) on failure. */
+cf_stream_reader_t* cf_stream_reader_open(FILE* in, cf_codec_t codec, int verify);
+
+/* Decode the next block into out (free it with cf_buffer_free). Returns 1 for
+ * a block, 0 at the end record once the totals check out, -1 on failure. */
+int cf_stream_read_block(cf_stream_reader_t* reader, cf_buffer_t* out);
+
+void cf_stream_reader_close(cf_stream_reader_t* reader);
+
+/* Write bytes [offset, offset + length) of the original data to out, decoding
+ * only the blocks that overlap them. in must be a seekable indexed container,
+ * a range past the end is cut short. Returns 0 on success or -1 on failure. */
+int cf_stream_read_range(FILE* in, FILE* out, uint64_t offset, uint64_t length, int verify);